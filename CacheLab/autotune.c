@@ -0,0 +1,463 @@
+/*
+ * autotune.c - Searches blocked transpose schedules for one matrix shape
+ *     and cache geometry, scoring each by the misses of its memory trace
+ *     on the cache simulator library, and prints the best ones along
+ *     with a C kernel implementing the winner.
+ *
+ * A schedule tiles the N x M matrix A into th x tw tiles, visits the
+ * tiles in row-major or column-major order, and inside a tile either
+ * walks A row by row or B row by row. With row buffering a tile row of
+ * A is read completely into locals before it is written to B, which
+ * keeps tiles on the diagonal from ping-ponging between A and B; a
+ * ragged last tile column falls back to the plain row walk.
+ *
+ * Square tiles can also be sub-blocked as in trans_64x64: the tile is
+ * moved in four quarters, parking the top right quarter in B until its
+ * rows of B are loaded anyway. With diagonal handling, tiles on the
+ * diagonal are instead copied row by row from A into B and transposed
+ * within B, as in trans_32x32. Incomplete tiles fall back to the row walk.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cachesim.h"
+
+/* Matrices are laid out like the static arrays in test-trans.c */
+#define MAXN 256
+
+/* Row buffering, quarters and the diagonal copy need one local per element of the tile row */
+#define MAX_BUFFERED 8
+
+struct schedule {
+    int th, tw;         /* tile height (rows of A) and width (columns of A) */
+    int tileColMajor;   /* visit tiles column by column */
+    int innerColMajor;  /* inside a tile, walk columns of A (rows of B) */
+    int buffered;       /* read a whole tile row of A before writing it */
+    int subBlocked;     /* move square tiles in quarters, through the top right of B */
+    int diagonal;       /* transpose square tiles on the diagonal within B */
+    int misses, hits;
+};
+
+/* The walks a tile can get, the search tries each with every tile shape */
+static const struct variant {
+    int innerColMajor, buffered, subBlocked, diagonal;
+} variants[] = {
+    {0, 0, 0, 0},
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 1, 0, 1},
+    {0, 0, 1, 0},
+    {0, 0, 1, 1},
+};
+
+/* Globals set on the command line */
+static int M = 0;
+static int N = 0;
+static struct cacheConfig config;
+static unsigned long long baseA = 0;    /* only its offset within the cache matters */
+static unsigned long long offsetB = (unsigned long long) MAXN * MAXN * sizeof(int);
+static unsigned long long baseB;
+
+/* Addresses of A[i][j] and B[j][i] */
+static unsigned long long addrA(int i, int j)
+{
+    return baseA + ((unsigned long long) i * M + j) * 4;
+}
+
+static unsigned long long addrB(int j, int i)
+{
+    return baseB + ((unsigned long long) j * N + i) * 4;
+}
+
+/*
+ * transpose_diagonal - Copy the t x t tile at (i0, j0) row by row from A
+ *     into B, then transpose it in place within B
+ */
+void transpose_diagonal(struct cacheSim *sim, int t, int i0, int j0)
+{
+    int i, j;
+
+    for (i = 0; i < t; i++) {
+        for (j = 0; j < t; j++)
+            cacheSimAccess(sim, 'L', addrA(i0 + i, j0 + j), 4);
+        for (j = 0; j < t; j++)
+            cacheSimAccess(sim, 'S', addrB(j0 + i, i0 + j), 4);
+    }
+    for (i = 0; i < t; i++) {
+        for (j = i + 1; j < t; j++) {
+            cacheSimAccess(sim, 'L', addrB(j0 + i, i0 + j), 4);
+            cacheSimAccess(sim, 'L', addrB(j0 + j, i0 + i), 4);
+            cacheSimAccess(sim, 'S', addrB(j0 + i, i0 + j), 4);
+            cacheSimAccess(sim, 'S', addrB(j0 + j, i0 + i), 4);
+        }
+    }
+}
+
+/*
+ * transpose_quarters - Move the t x t tile at (i0, j0) in quarters: the top
+ *     half of A goes to the left half of B, its right quarter transposed
+ *     into the top right of B for now, and is then swapped out column by
+ *     column while the bottom half of A fills the bottom rows of B.
+ */
+void transpose_quarters(struct cacheSim *sim, int t, int i0, int j0)
+{
+    int h = t / 2, i, j, k;
+
+    for (i = 0; i < h; i++) {
+        for (j = 0; j < t; j++)
+            cacheSimAccess(sim, 'L', addrA(i0 + i, j0 + j), 4);
+        for (j = 0; j < h; j++)
+            cacheSimAccess(sim, 'S', addrB(j0 + j, i0 + i), 4);
+        for (j = 0; j < h; j++)
+            cacheSimAccess(sim, 'S', addrB(j0 + j, i0 + h + i), 4);
+    }
+    for (j = 0; j < h; j++) {
+        for (k = 0; k < h; k++)
+            cacheSimAccess(sim, 'L', addrA(i0 + h + k, j0 + j), 4);
+        for (k = 0; k < h; k++)
+            cacheSimAccess(sim, 'L', addrA(i0 + h + k, j0 + h + j), 4);
+        for (k = 0; k < h; k++) {
+            cacheSimAccess(sim, 'L', addrB(j0 + j, i0 + h + k), 4);
+            cacheSimAccess(sim, 'S', addrB(j0 + j, i0 + h + k), 4);
+        }
+        for (k = 0; k < t; k++)
+            cacheSimAccess(sim, 'S', addrB(j0 + h + j, i0 + k), 4);
+    }
+}
+
+/*
+ * transpose_tile - Simulate the accesses of one tile of a schedule
+ */
+void transpose_tile(struct cacheSim *sim, const struct schedule *sc, int i0, int j0)
+{
+    int i, j, i1 = i0 + sc->th, j1 = j0 + sc->tw;
+    int full;
+
+    if (i1 > N) i1 = N;
+    if (j1 > M) j1 = M;
+    full = i1 - i0 == sc->th && j1 - j0 == sc->tw;
+
+    if (sc->diagonal && full && i0 == j0) {
+        transpose_diagonal(sim, sc->th, i0, j0);
+    } else if (sc->subBlocked && full) {
+        transpose_quarters(sim, sc->th, i0, j0);
+    } else if (sc->buffered && j1 - j0 == sc->tw) {
+        for (i = i0; i < i1; i++) {
+            for (j = j0; j < j1; j++)
+                cacheSimAccess(sim, 'L', addrA(i, j), 4);
+            for (j = j0; j < j1; j++)
+                cacheSimAccess(sim, 'S', addrB(j, i), 4);
+        }
+    } else if (sc->innerColMajor && !sc->buffered) {
+        for (j = j0; j < j1; j++) {
+            for (i = i0; i < i1; i++) {
+                cacheSimAccess(sim, 'L', addrA(i, j), 4);
+                cacheSimAccess(sim, 'S', addrB(j, i), 4);
+            }
+        }
+    } else {
+        for (i = i0; i < i1; i++) {
+            for (j = j0; j < j1; j++) {
+                cacheSimAccess(sim, 'L', addrA(i, j), 4);
+                cacheSimAccess(sim, 'S', addrB(j, i), 4);
+            }
+        }
+    }
+}
+
+/*
+ * evaluate - Run a schedule's trace through a fresh cache
+ */
+void evaluate(struct schedule *sc)
+{
+    struct cacheSim *sim = cacheSimCreate(&config);
+    struct cacheStats stats;
+    int ii, jj;
+
+    if (sc->tileColMajor) {
+        for (jj = 0; jj < M; jj += sc->tw)
+            for (ii = 0; ii < N; ii += sc->th)
+                transpose_tile(sim, sc, ii, jj);
+    } else {
+        for (ii = 0; ii < N; ii += sc->th)
+            for (jj = 0; jj < M; jj += sc->tw)
+                transpose_tile(sim, sc, ii, jj);
+    }
+
+    cacheSimStats(sim, &stats);
+    sc->misses = stats.misses;
+    sc->hits = stats.hits;
+    cacheSimFree(sim);
+}
+
+/*
+ * compare_schedules - qsort order: fewest misses, then the simplest loop nest
+ */
+int compare_schedules(const void *a, const void *b)
+{
+    const struct schedule *x = a, *y = b;
+
+    if (x->misses != y->misses)
+        return x->misses - y->misses;
+    if (x->buffered + x->subBlocked + x->diagonal != y->buffered + y->subBlocked + y->diagonal)
+        return (x->buffered + x->subBlocked + x->diagonal) - (y->buffered + y->subBlocked + y->diagonal);
+    return (y->th * y->tw) - (x->th * x->tw);
+}
+
+/*
+ * describe - One line summary of a schedule
+ */
+void describe(const struct schedule *sc)
+{
+    printf("misses:%-7d hits:%-7d tile:%3dx%-3d tiles:%s inner:%s%s%s\n",
+           sc->misses, sc->hits, sc->th, sc->tw,
+           sc->tileColMajor ? "col-major" : "row-major",
+           sc->subBlocked ? "quarters" : (sc->innerColMajor ? "col" : "row"),
+           sc->buffered ? " buffered" : "",
+           sc->diagonal ? " diagonal" : "");
+}
+
+/*
+ * emit_diagonal - Print the body of transpose_diagonal for a t x t tile
+ */
+void emit_diagonal(int t)
+{
+    int k;
+
+    printf("                for (i = 0; i < %d; ++i) {\n", t);
+    for (k = 0; k < t; k++)
+        printf("                    a%d = A[ii + i][jj + %d];\n", k, k);
+    for (k = 0; k < t; k++)
+        printf("                    B[jj + i][ii + %d] = a%d;\n", k, k);
+    printf("                }\n");
+    printf("                for (i = 0; i < %d; ++i) {\n", t);
+    printf("                    for (j = i + 1; j < %d; ++j) {\n", t);
+    printf("                        a0 = B[jj + i][ii + j];\n");
+    printf("                        B[jj + i][ii + j] = B[jj + j][ii + i];\n");
+    printf("                        B[jj + j][ii + i] = a0;\n");
+    printf("                    }\n");
+    printf("                }\n");
+}
+
+/*
+ * emit_quarters - Print the body of transpose_quarters for a t x t tile
+ */
+void emit_quarters(int t)
+{
+    int h = t / 2, k;
+
+    printf("                for (i = 0; i < %d; ++i) {\n", h);
+    for (k = 0; k < t; k++)
+        printf("                    a%d = A[ii + i][jj + %d];\n", k, k);
+    for (k = 0; k < h; k++)
+        printf("                    B[jj + %d][ii + i] = a%d;\n", k, k);
+    for (k = 0; k < h; k++)
+        printf("                    B[jj + %d][ii + %d + i] = a%d;\n", k, h, h + k);
+    printf("                }\n");
+    printf("                for (j = 0; j < %d; ++j) {\n", h);
+    for (k = 0; k < h; k++)
+        printf("                    a%d = A[ii + %d][jj + j];\n", k, h + k);
+    for (k = 0; k < h; k++)
+        printf("                    a%d = A[ii + %d][jj + %d + j];\n", h + k, h + k, h);
+    for (k = 0; k < h; k++)
+        printf("                    tmp = B[jj + j][ii + %d]; B[jj + j][ii + %d] = a%d; a%d = tmp;\n",
+               h + k, h + k, k, k);
+    for (k = 0; k < t; k++)
+        printf("                    B[jj + %d + j][ii + %d] = a%d;\n", h, k, k);
+    printf("                }\n");
+}
+
+/*
+ * emit_kernel - Print a transpose function that follows the schedule
+ */
+void emit_kernel(const struct schedule *sc)
+{
+    int k;
+    int unrolled = sc->buffered || sc->subBlocked || sc->diagonal;
+    const char *outer = sc->tileColMajor ? "jj" : "ii";
+    const char *inner = sc->tileColMajor ? "ii" : "jj";
+
+    printf("\nchar trans_%dx%d_tuned_desc[] = \"Autotuned %d x %d transpose (s=%d, E=%d, b=%d)\";\n",
+           N, M, N, M, config.s, config.E, config.b);
+    printf("void trans_%dx%d_tuned(int M, int N, int A[N][M], int B[M][N]) {\n", N, M);
+    printf("    int ii, jj, i, j;\n");
+    if (unrolled) {
+        printf("    int");
+        for (k = 0; k < sc->tw; k++)
+            printf("%s a%d", k ? "," : "", k);
+        printf(";\n");
+    }
+    if (sc->subBlocked)
+        printf("    int tmp;\n");
+    printf("\n");
+    printf("    for (%s = 0; %s < %s; %s += %d)\n", outer, outer, 
+           sc->tileColMajor ? "M" : "N", outer, sc->tileColMajor ? sc->tw : sc->th);
+    printf("        for (%s = 0; %s < %s; %s += %d)\n", inner, inner, 
+           sc->tileColMajor ? "N" : "M", inner, sc->tileColMajor ? sc->th : sc->tw);
+
+    if (unrolled) {
+        /* Only complete tiles are unrolled, the others take the row walk */
+        printf("            ");
+        if (sc->diagonal) {
+            printf("if (ii == jj && ii + %d <= N && jj + %d <= M) {\n", sc->th, sc->tw);
+            emit_diagonal(sc->th);
+            printf("            } else ");
+        }
+        if (sc->subBlocked) {
+            printf("if (ii + %d <= N && jj + %d <= M) {\n", sc->th, sc->tw);
+            emit_quarters(sc->th);
+            printf("            } else {\n");
+            printf("                for (i = ii; i < ii + %d && i < N; ++i)\n", sc->th);
+            printf("                    for (j = jj; j < jj + %d && j < M; ++j)\n", sc->tw);
+            printf("                        B[j][i] = A[i][j];\n");
+            printf("            }\n");
+        } else {
+            printf("if (jj + %d <= M) {\n", sc->tw);
+            printf("                for (i = ii; i < ii + %d && i < N; ++i) {\n", sc->th);
+            for (k = 0; k < sc->tw; k++)
+                printf("                    a%d = A[i][jj + %d];\n", k, k);
+            for (k = 0; k < sc->tw; k++)
+                printf("                    B[jj + %d][i] = a%d;\n", k, k);
+            printf("                }\n");
+            printf("            } else {\n");
+            printf("                for (i = ii; i < ii + %d && i < N; ++i)\n", sc->th);
+            printf("                    for (j = jj; j < M; ++j)\n");
+            printf("                        B[j][i] = A[i][j];\n");
+            printf("            }\n");
+        }
+    } else if (sc->innerColMajor) {
+        printf("            for (j = jj; j < jj + %d && j < M; ++j)\n", sc->tw);
+        printf("                for (i = ii; i < ii + %d && i < N; ++i)\n", sc->th);
+        printf("                    B[j][i] = A[i][j];\n");
+    } else {
+        printf("            for (i = ii; i < ii + %d && i < N; ++i)\n", sc->th);
+        printf("                for (j = jj; j < jj + %d && j < M; ++j)\n", sc->tw);
+        printf("                    B[j][i] = A[i][j];\n");
+    }
+    printf("}\n");
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[])
+{
+    printf("Usage: %s [-hg] [-k <num>] [-a <addr>] [-o <bytes>] -M <cols> -N <rows> -s <s> -E <E> -b <b>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -g          Print a C kernel for the best schedule.\n");
+    printf("  -k <num>    Number of schedules to list (default 10).\n");
+    printf("  -a <addr>   Address of A in hex (default 0).\n");
+    printf("  -o <bytes>  Distance from A to B (default %llu, as in test-trans).\n", offsetB);
+    printf("  -M <cols>   Number of matrix columns of A\n");
+    printf("  -N <rows>   Number of matrix rows of A\n");
+    printf("  -s, -E, -b  Cache geometry, as for csim\n");
+    printf("Example: %s -g -M 64 -N 64 -s 5 -E 1 -b 5\n", argv[0]);
+}
+
+/*
+ * main - Enumerate, evaluate and rank the schedules
+ */
+int main(int argc, char *argv[])
+{
+    static const int sizes[] = {1, 2, 4, 8, 12, 16, 24, 32, 48, 64, 128, 256};
+    int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+    int top = 10, generate = 0;
+    int numVariants = sizeof(variants) / sizeof(variants[0]);
+    int h, w, order, v, count = 0, i;
+    struct schedule *schedules;
+    char c;
+
+    config.s = config.E = config.b = -1;
+    while ((c = getopt(argc, argv, "M:N:s:E:b:k:a:o:gh")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 's':
+            config.s = atoi(optarg);
+            break;
+        case 'E':
+            config.E = atoi(optarg);
+            break;
+        case 'b':
+            config.b = atoi(optarg);
+            break;
+        case 'k':
+            top = atoi(optarg);
+            break;
+        case 'a':
+            baseA = strtoull(optarg, NULL, 16);
+            break;
+        case 'o':
+            offsetB = strtoull(optarg, NULL, 0);
+            break;
+        case 'g':
+            generate = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (M <= 0 || N <= 0 || config.s < 0 || config.E < 1 || config.b < 0) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    baseB = baseA + offsetB;
+    /* At most every tile shape in both orders with every variant */
+    schedules = malloc((size_t) numSizes * numSizes * 2 * numVariants * sizeof(struct schedule));
+    if (schedules == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    /* Tile shapes beyond the matrix add nothing over the full extent */
+    for (h = 0; h < numSizes && (h == 0 || sizes[h - 1] < N); h++) {
+        for (w = 0; w < numSizes && (w == 0 || sizes[w - 1] < M); w++) {
+            for (order = 0; order < 2; order++) {
+                for (v = 0; v < numVariants; v++) {
+                    const struct variant *var = &variants[v];
+                    struct schedule *sc = &schedules[count];
+                    if ((var->buffered || var->subBlocked || var->diagonal) && sizes[w] > MAX_BUFFERED)
+                        continue;
+                    /* Quarters and the diagonal copy need square tiles of even size */
+                    if ((var->subBlocked || var->diagonal) && (sizes[h] != sizes[w] || sizes[w] % 2))
+                        continue;
+                    memset(sc, 0, sizeof(*sc));
+                    sc->th = sizes[h];
+                    sc->tw = sizes[w];
+                    sc->tileColMajor = order;
+                    sc->innerColMajor = var->innerColMajor;
+                    sc->buffered = var->buffered;
+                    sc->subBlocked = var->subBlocked;
+                    sc->diagonal = var->diagonal;
+                    evaluate(sc);
+                    count++;
+                }
+            }
+        }
+    }
+
+    qsort(schedules, count, sizeof(struct schedule), compare_schedules);
+
+    printf("Evaluated %d schedules for %d x %d (s=%d, E=%d, b=%d)\n", 
+           count, N, M, config.s, config.E, config.b);
+    for (i = 0; i < top && i < count; i++)
+        describe(&schedules[i]);
+    if (generate)
+        emit_kernel(&schedules[0]);
+
+    free(schedules);
+    return 0;
+}
@@ -4,22 +4,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "cachelab.h"
 #include <time.h>
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0; 
 
+kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+int kernel_counter = 0;
+
+static const char* kernel_names[NUM_KERNEL_KINDS] = {"mm", "stencil", "conv"};
+
 /* 
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
  */
-void printSummary(int hits, int misses, int evictions)
+void printSummary(unsigned long long hits, unsigned long long misses, unsigned long long evictions)
 {
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+    printf("hits:%llu misses:%llu evictions:%llu\n", hits, misses, evictions);
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fprintf(output_fp, "%llu %llu %llu\n", hits, misses, evictions);
     fclose(output_fp);
 }
 
@@ -81,3 +87,180 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/* 
+ * newKernel - Append an entry of the given kind to the kernel list
+ */
+static kernel_func_t* newKernel(int kind, char* desc)
+{
+    kernel_func_t* f = &kernel_list[kernel_counter++];
+
+    assert(kernel_counter <= MAX_KERNEL_FUNCS);
+    memset(f, 0, sizeof(*f));
+    f->kind = kind;
+    f->description = desc;
+    return f;
+}
+
+/* 
+ * registerMMFunction, registerStencilFunction, registerConvFunction -
+ *     Add the given kernel into your list of functions to be tested
+ */
+void registerMMFunction(
+    void (*mm)(int M,int N,int K,int[N][K],int[K][M],int[N][M]), char* desc)
+{
+    newKernel(KERNEL_MM, desc)->func_ptr.mm = mm;
+}
+
+void registerStencilFunction(
+    void (*stencil)(int M,int N,int[N][M],int[N][M]), char* desc)
+{
+    newKernel(KERNEL_STENCIL, desc)->func_ptr.stencil = stencil;
+}
+
+void registerConvFunction(
+    void (*conv)(int M,int N,int K,int[N][M],int[K][K],int[N-K+1][M-K+1]), char* desc)
+{
+    newKernel(KERNEL_CONV, desc)->func_ptr.conv = conv;
+}
+
+int kernelKind(const char* name)
+{
+    int kind;
+
+    for (kind = 0; kind < NUM_KERNEL_KINDS; kind++)
+        if (strcmp(name, kernel_names[kind]) == 0)
+            return kind;
+    return -1;
+}
+
+const char* kernelName(int kind)
+{
+    return kind >= 0 && kind < NUM_KERNEL_KINDS ? kernel_names[kind] : "trans";
+}
+
+void kernelSizes(int kind, int M, int N, int K, size_t sizes[3])
+{
+    switch (kind) {
+    case KERNEL_MM:
+        sizes[0] = (size_t)N * K;
+        sizes[1] = (size_t)K * M;
+        sizes[2] = (size_t)N * M;
+        break;
+    case KERNEL_STENCIL:
+        sizes[0] = (size_t)N * M;
+        sizes[1] = 0;
+        sizes[2] = (size_t)N * M;
+        break;
+    default:
+        sizes[0] = (size_t)N * M;
+        sizes[1] = (size_t)K * K;
+        sizes[2] = (size_t)(N - K + 1) * (M - K + 1);
+        break;
+    }
+}
+
+/* 
+ * initKernel - Small values keep every sum and product of ints exact
+ */
+void initKernel(int kind, int M, int N, int K, int* A, int* B, int* C)
+{
+    size_t sizes[3], i;
+
+    kernelSizes(kind, M, N, K, sizes);
+    srand(time(NULL));
+    for (i = 0; i < sizes[0]; i++)
+        A[i] = rand() % 1000;
+    for (i = 0; i < sizes[1]; i++)
+        B[i] = rand() % 1000;
+    for (i = 0; i < sizes[2]; i++)
+        C[i] = rand();
+}
+
+void runKernel(const kernel_func_t* f, int M, int N, int K, int* A, int* B, int* C)
+{
+    switch (f->kind) {
+    case KERNEL_MM:
+        (*f->func_ptr.mm)(M, N, K, (int (*)[K])A, (int (*)[M])B, (int (*)[M])C);
+        break;
+    case KERNEL_STENCIL:
+        (*f->func_ptr.stencil)(M, N, (int (*)[M])A, (int (*)[M])C);
+        break;
+    case KERNEL_CONV:
+        (*f->func_ptr.conv)(M, N, K, (int (*)[M])A, (int (*)[K])B, (int (*)[M - K + 1])C);
+        break;
+    }
+}
+
+/* 
+ * correctMM, correctStencil, correctConv - baseline kernels used to
+ *     evaluate correctness
+ */
+static void correctMM(int M, int N, int K, int A[N][K], int B[K][M], int C[N][M])
+{
+    int i, j, k;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < M; j++){
+            C[i][j] = 0;
+            for (k = 0; k < K; k++)
+                C[i][j] += A[i][k] * B[k][j];
+        }
+    }
+}
+
+static void correctStencil(int M, int N, int A[N][M], int C[N][M])
+{
+    int i, j;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < M; j++){
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                C[i][j] = A[i][j];
+            else
+                C[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+        }
+    }
+}
+
+static void correctConv(int M, int N, int K, int A[N][M], int B[K][K], int C[N-K+1][M-K+1])
+{
+    int i, j, u, v;
+    for (i = 0; i < N - K + 1; i++){
+        for (j = 0; j < M - K + 1; j++){
+            C[i][j] = 0;
+            for (u = 0; u < K; u++)
+                for (v = 0; v < K; v++)
+                    C[i][j] += A[i + u][j + v] * B[u][v];
+        }
+    }
+}
+
+int checkKernel(int kind, int M, int N, int K, int* A, int* B, int* C)
+{
+    size_t sizes[3], i;
+    int* expect;
+    int ok = 1;
+
+    kernelSizes(kind, M, N, K, sizes);
+    expect = malloc(sizes[2] * sizeof(int));
+    assert(expect);
+    switch (kind) {
+    case KERNEL_MM:
+        correctMM(M, N, K, (int (*)[K])A, (int (*)[M])B, (int (*)[M])expect);
+        break;
+    case KERNEL_STENCIL:
+        correctStencil(M, N, (int (*)[M])A, (int (*)[M])expect);
+        break;
+    case KERNEL_CONV:
+        correctConv(M, N, K, (int (*)[M])A, (int (*)[K])B, (int (*)[M - K + 1])expect);
+        break;
+    }
+    for (i = 0; i < sizes[2] && ok; i++) {
+        if (C[i] != expect[i]) {
+            printf("Validation failed on %s kernel! Expected %d but got %d at C[%zu]\n",
+                   kernelName(kind), expect[i], C[i], i);
+            ok = 0;
+        }
+    }
+    free(expect);
+    return ok;
+}
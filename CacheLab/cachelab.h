@@ -5,7 +5,20 @@
 #ifndef CACHELAB_TOOLS_H
 #define CACHELAB_TOOLS_H
 
+#include <stddef.h>
+
 #define MAX_TRANS_FUNCS 100
+#define MAX_KERNEL_FUNCS 100
+
+/* 
+ * Kinds of kernel other than transpose that test-trans -k evaluates. M
+ * counts columns and N rows, as for transpose, and K is the inner
+ * dimension of a multiply or the width of a convolution filter.
+ */
+#define KERNEL_MM      0    /* C[N][M] = A[N][K] * B[K][M] */
+#define KERNEL_STENCIL 1    /* C[N][M] = 5-point sum of A[N][M], border copied */
+#define KERNEL_CONV    2    /* C[N-K+1][M-K+1] = A[N][M] correlated with B[K][K] */
+#define NUM_KERNEL_KINDS 3
 
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
@@ -16,13 +29,27 @@ typedef struct trans_func{
   unsigned int num_evictions;
 } trans_func_t;
 
+typedef struct kernel_func{
+  int kind;
+  union {
+    void (*mm)(int M,int N,int K,int[N][K],int[K][M],int[N][M]);
+    void (*stencil)(int M,int N,int[N][M],int[N][M]);
+    void (*conv)(int M,int N,int K,int[N][M],int[K][K],int[N-K+1][M-K+1]);
+  } func_ptr;
+  char* description;
+  char correct;
+  unsigned int num_hits;
+  unsigned int num_misses;
+  unsigned int num_evictions;
+} kernel_func_t;
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
  */ 
-void printSummary(int hits,  /* number of  hits */
-				  int misses, /* number of misses */
-				  int evictions); /* number of evictions */
+void printSummary(unsigned long long hits,  /* number of  hits */
+				  unsigned long long misses, /* number of misses */
+				  unsigned long long evictions); /* number of evictions */
 
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
@@ -34,4 +61,28 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Add the given kernel to the list of its kind */
+void registerMMFunction(
+    void (*mm)(int M,int N,int K,int[N][K],int[K][M],int[N][M]), char* desc);
+void registerStencilFunction(
+    void (*stencil)(int M,int N,int[N][M],int[N][M]), char* desc);
+void registerConvFunction(
+    void (*conv)(int M,int N,int K,int[N][M],int[K][K],int[N-K+1][M-K+1]), char* desc);
+
+/* KERNEL_* of a name such as "mm", -1 if there is none */
+int kernelKind(const char* name);
+const char* kernelName(int kind);
+
+/* Number of ints a kernel of this kind uses in each of A, B and C */
+void kernelSizes(int kind, int M, int N, int K, size_t sizes[3]);
+
+/* Fill the inputs of a kernel with small random values and clobber C */
+void initKernel(int kind, int M, int N, int K, int* A, int* B, int* C);
+
+/* Call a registered kernel on the operands */
+void runKernel(const kernel_func_t* f, int M, int N, int K, int* A, int* B, int* C);
+
+/* Check C against a baseline kernel of the same kind, 1 if it matches */
+int checkKernel(int kind, int M, int N, int K, int* A, int* B, int* C);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,813 @@
+/*
+ * cachesim.c - Cache simulator library, see cachesim.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cachesim.h"
+
+struct cacheLine {
+    int valid;
+    int dirty;
+    int prefetched;         /* filled by the prefetcher and not referenced yet */
+    unsigned long long tag;
+    unsigned long long lastUsedTime;
+};
+
+/* Write handling, the defaults (write-back, write-allocate) match csim-ref */
+struct cachePolicy {
+    int writeThrough;       /* stores update memory immediately instead of on eviction */
+    int noWriteAllocate;    /* store misses bypass the cache */
+    int blockSize;          /* bytes moved per line fill or write-back */
+};
+
+#define STRIDE_TABLE_SIZE 256
+#define NUM_STREAMS 4
+#define STREAM_DEPTH 4
+
+struct strideEntry {
+    int valid;
+    unsigned long long pc, lastAddress;
+    long long stride;
+    int confidence;
+};
+
+struct streamBuffer {
+    unsigned long long blocks[STREAM_DEPTH];    /* FIFO of upcoming blocks */
+    int count;
+    unsigned long long lastUsedTime;
+};
+
+struct prefetcher {
+    int kind;
+    struct cacheLine *cache;    /* the whole (unpartitioned) cache */
+    int s, E, b;
+    struct strideEntry strideTable[STRIDE_TABLE_SIZE];
+    struct streamBuffer streams[NUM_STREAMS];
+};
+
+/* A data access routed to one simulation thread */
+struct access {
+    char operation;
+    int size;
+    unsigned long long tag;
+    int localSetIndex;      /* set index inside the owning thread's private sets */
+    unsigned long long time;    /* position in the trace, drives LRU across threads */
+};
+
+/* 
+ * A simulation thread owns every set whose index is congruent to its id
+ * modulo the number of threads, so the per-set access order is preserved
+ * and threads never share a cache line.
+ */
+struct simThread {
+    pthread_t thread;
+    struct cacheLine *cache;    /* numLocalSets * E lines */
+    int E;
+    const struct cachePolicy *policy;
+    struct access *accesses;
+    int numAccesses, capacity;
+    struct cacheStats stats;
+};
+
+/* lruLine - Return the index of the least recently used line of a full set */
+static int lruLine (struct cacheLine *cacheSet, int E) {
+    int minIndex = 0;
+    for (int i = 1; i < E; ++i) {
+        if (cacheSet[i].lastUsedTime < cacheSet[minIndex].lastUsedTime)
+            minIndex = i;
+    }
+    return minIndex;
+}
+
+/* retireLine - Account for the block leaving a valid line */
+static void retireLine (struct cacheLine *line, const struct cachePolicy *policy, struct cacheStats *stats) {
+    if (line->dirty) {
+        ++stats->dirtyEvictions;
+        stats->bytesWritten += policy->blockSize;
+    }
+    if (line->prefetched)
+        ++stats->unusedPrefetches;
+    line->dirty = 0;
+    line->prefetched = 0;
+}
+
+/* 
+ * cacheVisit - Look up a block for a load or a store. Returns the line now
+ *     holding the block, or NULL when a store miss bypasses the cache.
+ */
+static struct cacheLine *cacheVisit (struct cacheLine *cacheSet, unsigned long long tag, int E, unsigned long long time, int isStore, const struct cachePolicy *policy, struct cacheStats *stats, int verboseFlag) {
+    int vacantLineIndex = -1;
+    for (int i = 0; i < E; ++i) {
+        if (cacheSet[i].valid) {
+            if (cacheSet[i].tag == tag) {
+                ++stats->hits;
+                cacheSet[i].lastUsedTime = time;
+                if (cacheSet[i].prefetched) {
+                    ++stats->usefulPrefetches;
+                    cacheSet[i].prefetched = 0;
+                }
+
+                if (verboseFlag)
+                    printf(" hit");
+                return &cacheSet[i];
+            }
+        } else 
+            vacantLineIndex = i;
+    }
+
+    ++stats->misses;
+    if (verboseFlag)
+        printf(" miss");    
+    if (isStore && policy->noWriteAllocate)
+        return NULL;
+
+    stats->bytesRead += policy->blockSize;
+    if (vacantLineIndex != -1) {
+        cacheSet[vacantLineIndex].valid = 1;
+        cacheSet[vacantLineIndex].dirty = 0;
+        cacheSet[vacantLineIndex].prefetched = 0;
+        cacheSet[vacantLineIndex].tag = tag;
+        cacheSet[vacantLineIndex].lastUsedTime = time;
+        return &cacheSet[vacantLineIndex];
+    }
+
+    ++stats->evictions;
+    if (verboseFlag)
+        printf(" eviction");
+    int minIndex = lruLine(cacheSet, E);
+    retireLine(&cacheSet[minIndex], policy, stats);
+    cacheSet[minIndex].tag = tag;
+    cacheSet[minIndex].lastUsedTime = time;
+
+    return &cacheSet[minIndex];
+}
+
+/* 
+ * cachePrefetch - Install a block on behalf of the prefetcher unless it is
+ *     already cached. Returns 1 if the block was installed.
+ */
+static int cachePrefetch (struct cacheLine *cacheSet, unsigned long long tag, int E, unsigned long long time, const struct cachePolicy *policy, struct cacheStats *stats) {
+    int index = -1;
+    for (int i = 0; i < E; ++i) {
+        if (!cacheSet[i].valid)
+            index = i;
+        else if (cacheSet[i].tag == tag)
+            return 0;
+    }
+
+    if (index == -1) {
+        index = lruLine(cacheSet, E);
+        retireLine(&cacheSet[index], policy, stats);
+    }
+    cacheSet[index].valid = 1;
+    cacheSet[index].dirty = 0;
+    cacheSet[index].prefetched = 1;
+    cacheSet[index].tag = tag;
+    cacheSet[index].lastUsedTime = time;
+    return 1;
+}
+
+/* cacheWrite - Apply the write policy to a store of size bytes, line is NULL if it missed the cache */
+static void cacheWrite (struct cacheLine *line, int size, const struct cachePolicy *policy, struct cacheStats *stats) {
+    if (line == NULL || policy->writeThrough)
+        stats->bytesWritten += size;
+    else
+        line->dirty = 1;
+}
+
+/* cacheOperate - Apply one trace operation ('L', 'S' or 'M') to a cache set */
+static void cacheOperate (struct cacheLine *cacheSet, char operation, unsigned long long tag, int size, int E, unsigned long long time, const struct cachePolicy *policy, struct cacheStats *stats, int verboseFlag) {
+    struct cacheLine *line;
+
+    switch (operation) {
+        case 'L':
+            cacheVisit(cacheSet, tag, E, time, 0, policy, stats, verboseFlag);
+            break;
+        case 'S':
+            line = cacheVisit(cacheSet, tag, E, time, 1, policy, stats, verboseFlag); 
+            cacheWrite(line, size, policy, stats);
+            break;
+        case 'M':
+            line = cacheVisit(cacheSet, tag, E, time, 0, policy, stats, verboseFlag);
+            ++stats->hits;
+            if (verboseFlag)
+                printf(" hit");
+            cacheWrite(line, size, policy, stats);
+            break;
+    }
+}
+
+/* addStats - Accumulate the counters of src into dst */
+static void addStats (struct cacheStats *dst, const struct cacheStats *src) {
+    dst->hits += src->hits;
+    dst->misses += src->misses;
+    dst->evictions += src->evictions;
+    dst->dirtyEvictions += src->dirtyEvictions;
+    dst->bytesRead += src->bytesRead;
+    dst->bytesWritten += src->bytesWritten;
+    dst->prefetches += src->prefetches;
+    dst->usefulPrefetches += src->usefulPrefetches;
+    dst->unusedPrefetches += src->unusedPrefetches;
+}
+
+/* prefetchBlock - Bring a block into the cache ahead of demand */
+static void prefetchBlock (struct prefetcher *pf, unsigned long long block, unsigned long long time, const struct cachePolicy *policy, struct cacheStats *stats) {
+    struct cacheLine *cacheSet = &pf->cache[(block & ((1 << pf->s) - 1)) * pf->E];
+
+    if (cachePrefetch(cacheSet, block >> pf->s, pf->E, time, policy, stats)) {
+        ++stats->prefetches;
+        stats->bytesRead += policy->blockSize;
+    }
+}
+
+/* fillStream - Point a stream buffer at the blocks following block */
+static void fillStream (struct streamBuffer *sb, unsigned long long block, unsigned long long time, const struct cachePolicy *policy, struct cacheStats *stats) {
+    stats->unusedPrefetches += sb->count;
+    for (int i = 0; i < STREAM_DEPTH; ++i) 
+        sb->blocks[i] = block + 1 + i;
+    sb->count = STREAM_DEPTH;
+    sb->lastUsedTime = time;
+    stats->prefetches += STREAM_DEPTH;
+    stats->bytesRead += (unsigned long long)STREAM_DEPTH * policy->blockSize;
+}
+
+/* 
+ * prefetchBeforeAccess - A block missing from the cache but waiting in a
+ *     stream buffer moves into the cache, so the demand access hits it.
+ */
+static void prefetchBeforeAccess (struct prefetcher *pf, unsigned long long block, unsigned long long time, const struct cachePolicy *policy, struct cacheStats *stats) {
+    if (pf->kind != PREFETCH_STREAM)
+        return;
+
+    for (int i = 0; i < NUM_STREAMS; ++i) {
+        struct streamBuffer *sb = &pf->streams[i];
+        for (int j = 0; j < sb->count; ++j) {
+            if (sb->blocks[j] != block)
+                continue;
+
+            // blocks ahead of the match were skipped over by the stream
+            struct cacheLine *cacheSet = &pf->cache[(block & ((1 << pf->s) - 1)) * pf->E];
+            if (!cachePrefetch(cacheSet, block >> pf->s, pf->E, time, policy, stats))
+                ++stats->unusedPrefetches;
+            stats->unusedPrefetches += j;
+
+            unsigned long long last = sb->blocks[sb->count - 1];
+            memmove(sb->blocks, sb->blocks + j + 1, (sb->count - j - 1) * sizeof(sb->blocks[0]));
+            sb->count -= j + 1;
+            while (sb->count < STREAM_DEPTH) {
+                sb->blocks[sb->count++] = ++last;
+                ++stats->prefetches;
+                stats->bytesRead += policy->blockSize;
+            }
+            sb->lastUsedTime = time;
+            return;
+        }
+    }
+}
+
+/* 
+ * prefetchAfterAccess - Train the prefetcher on a demand access and issue
+ *     whatever it predicts. missed and usedPrefetch describe the outcome.
+ */
+static void prefetchAfterAccess (struct prefetcher *pf, unsigned long long pc, unsigned long long address, int missed, int usedPrefetch, unsigned long long time, const struct cachePolicy *policy, struct cacheStats *stats) {
+    unsigned long long block = address >> pf->b;
+
+    switch (pf->kind) {
+        case PREFETCH_NEXT:
+            if (missed || usedPrefetch)
+                prefetchBlock(pf, block + 1, time, policy, stats);
+            break;
+        case PREFETCH_STRIDE: {
+            struct strideEntry *e = &pf->strideTable[(pc ^ (pc >> 8)) % STRIDE_TABLE_SIZE];
+            if (!e->valid || e->pc != pc) {
+                e->valid = 1;
+                e->pc = pc;
+                e->lastAddress = address;
+                e->stride = 0;
+                e->confidence = 0;
+                break;
+            }
+
+            long long stride = (long long)(address - e->lastAddress);
+            if (stride != 0 && stride == e->stride) {
+                if (e->confidence < 3)
+                    ++e->confidence;
+            } else {
+                e->stride = stride;
+                e->confidence = 0;
+            }
+            e->lastAddress = address;
+
+            // look far enough ahead that small strides still reach a new block
+            if (e->confidence >= 2) {
+                long long distance = (long long)(1 << pf->b) / (e->stride < 0 ? -e->stride : e->stride);
+                if (distance < 1)
+                    distance = 1;
+                prefetchBlock(pf, (address + e->stride * distance) >> pf->b, time, policy, stats);
+            }
+            break;
+        }
+        case PREFETCH_STREAM:
+            if (missed) {
+                struct streamBuffer *victim = &pf->streams[0];
+                for (int i = 1; i < NUM_STREAMS; ++i) 
+                    if (pf->streams[i].lastUsedTime < victim->lastUsedTime)
+                        victim = &pf->streams[i];
+                fillStream(victim, block, time, policy, stats);
+            }
+            break;
+    }
+}
+
+/* Misses attributed to one named address range of the trace */
+#define MAX_REGIONS 64
+struct region {
+    char name[64];
+    unsigned long long base, size;
+    unsigned long long hits, misses, evictions;
+    unsigned long long compulsory, capacity, conflict;
+};
+
+/* Fully associative LRU cache with the capacity of the real one */
+struct faNode {
+    unsigned long long block;
+    int prev, next;         /* recency list, head is most recently used */
+    int chain;              /* next node in the same hash bucket */
+};
+
+struct faCache {
+    struct faNode *nodes;
+    int *buckets;
+    int numBuckets;         /* power of two */
+    int capacity, size;
+    int head, tail;
+};
+
+/* Every block referenced so far, open addressing on block + 1 */
+struct blockSet {
+    unsigned long long *slots;
+    size_t numSlots, count;
+};
+
+/* 
+ * missReport - State behind the optional per-region and 3C miss report.
+ *     The last entry of regions collects accesses outside every range.
+ */
+struct missReport {
+    int classify;
+    int numRegions;
+    struct region regions[MAX_REGIONS + 1];
+    struct faCache fa;
+    struct blockSet seen;
+};
+
+/* hashBlock - Mix a block number into a hash table index */
+static size_t hashBlock (unsigned long long block) {
+    block ^= block >> 33;
+    block *= 0xff51afd7ed558ccdULL;
+    block ^= block >> 33;
+    return (size_t)block;
+}
+
+/* faInit - Set up an empty fully associative cache of capacity lines, returns -1 if out of memory */
+static int faInit (struct faCache *fa, int capacity) {
+    fa->capacity = capacity;
+    fa->size = 0;
+    fa->head = fa->tail = -1;
+    fa->numBuckets = 1;
+    while (fa->numBuckets < 2 * capacity)
+        fa->numBuckets <<= 1;
+    fa->nodes = malloc(capacity * sizeof(struct faNode));
+    fa->buckets = malloc(fa->numBuckets * sizeof(int));
+    if (fa->nodes == NULL || fa->buckets == NULL)
+        return -1;
+    for (int i = 0; i < fa->numBuckets; ++i)
+        fa->buckets[i] = -1;
+    return 0;
+}
+
+/* faUnlink - Take a node out of the recency list */
+static void faUnlink (struct faCache *fa, int n) {
+    struct faNode *node = &fa->nodes[n];
+    if (node->prev != -1)
+        fa->nodes[node->prev].next = node->next;
+    else
+        fa->head = node->next;
+    if (node->next != -1)
+        fa->nodes[node->next].prev = node->prev;
+    else
+        fa->tail = node->prev;
+}
+
+/* faPushFront - Make a node the most recently used */
+static void faPushFront (struct faCache *fa, int n) {
+    fa->nodes[n].prev = -1;
+    fa->nodes[n].next = fa->head;
+    if (fa->head != -1)
+        fa->nodes[fa->head].prev = n;
+    fa->head = n;
+    if (fa->tail == -1)
+        fa->tail = n;
+}
+
+/* faAccess - Reference a block, returns 1 on a hit */
+static int faAccess (struct faCache *fa, unsigned long long block) {
+    int *bucket = &fa->buckets[hashBlock(block) & (fa->numBuckets - 1)];
+    for (int n = *bucket; n != -1; n = fa->nodes[n].chain) {
+        if (fa->nodes[n].block == block) {
+            faUnlink(fa, n);
+            faPushFront(fa, n);
+            return 1;
+        }
+    }
+
+    int n;
+    if (fa->size < fa->capacity)
+        n = fa->size++;
+    else {
+        // recycle the LRU node after dropping it from its bucket
+        n = fa->tail;
+        faUnlink(fa, n);
+        int *link = &fa->buckets[hashBlock(fa->nodes[n].block) & (fa->numBuckets - 1)];
+        while (*link != n)
+            link = &fa->nodes[*link].chain;
+        *link = fa->nodes[n].chain;
+    }
+    fa->nodes[n].block = block;
+    fa->nodes[n].chain = *bucket;
+    *bucket = n;
+    faPushFront(fa, n);
+    return 0;
+}
+
+/* blockSetInsert - Add a block, returns 1 if it was not in the set yet */
+static int blockSetInsert (struct blockSet *set, unsigned long long block) {
+    if (2 * (set->count + 1) > set->numSlots) {
+        struct blockSet grown = {NULL, set->numSlots ? 2 * set->numSlots : 1024, 0};
+        grown.slots = calloc(grown.numSlots, sizeof(unsigned long long));
+        if (grown.slots == NULL) {
+            fprintf(stderr, "Out of memory classifying misses\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < set->numSlots; ++i)
+            if (set->slots[i])
+                blockSetInsert(&grown, set->slots[i] - 1);
+        free(set->slots);
+        *set = grown;
+    }
+
+    size_t i = hashBlock(block) & (set->numSlots - 1);
+    while (set->slots[i]) {
+        if (set->slots[i] == block + 1)
+            return 0;
+        i = (i + 1) & (set->numSlots - 1);
+    }
+    set->slots[i] = block + 1;
+    ++set->count;
+    return 1;
+}
+
+/* 
+ * attributeAccess - Charge the outcome of one block visit, the difference
+ *     between before and after, to its region and miss class, and return
+ *     the CACHE_* class of a miss.
+ */
+static int attributeAccess (struct missReport *report, unsigned long long address, unsigned long long block, const struct cacheStats *before, const struct cacheStats *after) {
+    struct region *r = &report->regions[0];
+    while (r != &report->regions[report->numRegions] && (address < r->base || address - r->base >= r->size))
+        ++r;
+
+    r->hits += after->hits - before->hits;
+    r->misses += after->misses - before->misses;
+    r->evictions += after->evictions - before->evictions;
+    if (!report->classify)
+        return 0;
+
+    // compulsory: first reference, capacity: a fully associative cache misses too
+    int firstReference = blockSetInsert(&report->seen, block);
+    int faHit = faAccess(&report->fa, block);
+    if (after->misses == before->misses)
+        return 0;
+    if (firstReference) {
+        ++r->compulsory;
+        return CACHE_COMPULSORY;
+    }
+    if (!faHit) {
+        ++r->capacity;
+        return CACHE_CAPACITY;
+    }
+    ++r->conflict;
+    return CACHE_CONFLICT;
+}
+
+/* appendAccess - Append an access to a thread's stream, growing it as needed */
+static void appendAccess (struct simThread *t, char operation, int size, unsigned long long tag, int localSetIndex, unsigned long long time) {
+    if (t->numAccesses == t->capacity) {
+        t->capacity = t->capacity ? 2 * t->capacity : 4096;
+        t->accesses = realloc(t->accesses, t->capacity * sizeof(struct access));
+        if (t->accesses == NULL) {
+            fprintf(stderr, "Out of memory buffering the trace\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct access *a = &t->accesses[t->numAccesses++];
+    a->operation = operation;
+    a->size = size;
+    a->tag = tag;
+    a->localSetIndex = localSetIndex;
+    a->time = time;
+}
+
+/* simulateStream - Thread routine, replays one thread's accesses on its own sets */
+static void *simulateStream (void *arg) {
+    struct simThread *t = arg;
+
+    for (int i = 0; i < t->numAccesses; ++i) {
+        struct access *a = &t->accesses[i];
+        cacheOperate(&t->cache[a->localSetIndex * t->E], a->operation, a->tag, a->size, t->E, a->time, 
+                     t->policy, &t->stats, 0);
+    }
+    return NULL;
+}
+
+
+struct cacheSim {
+    struct cacheConfig config;
+    struct cachePolicy policy;
+    int numThreads, numLocalSets;
+    struct simThread *threads;      /* one when serial */
+    struct cacheStats stats;        /* accesses simulated on the calling thread */
+    unsigned long long time;        /* trace position, drives LRU */
+    unsigned long long straddles;
+    unsigned long long pc;          /* address of the last 'I' record */
+
+    // the prefetcher sees the whole cache, a shadow cache without it measures pollution
+    struct prefetcher pf;
+    struct cacheLine *shadow;
+    struct cacheStats shadowStats;
+    unsigned long long pollution;
+
+    struct missReport report;
+    int reportFlag;
+};
+
+struct cacheSim *cacheSimCreate(const struct cacheConfig *config) {
+    int s = config->s, E = config->E, b = config->b;
+    if (s < 0 || E < 1 || b < 0 || s + b > 62 || s > 30)
+        return NULL;
+
+    struct cacheSim *sim = calloc(1, sizeof(struct cacheSim));
+    if (sim == NULL)
+        return NULL;
+    sim->config = *config;
+    sim->policy.writeThrough = config->writeThrough;
+    sim->policy.noWriteAllocate = config->noWriteAllocate;
+    sim->policy.blockSize = 1 << b;
+
+    // verbose output follows trace order and prefetches cross sets, so both run serially,
+    // as does the 3C classification which needs a view of the whole cache
+    sim->numThreads = config->numThreads;
+    if (sim->numThreads < 1 || config->verbose || config->prefetcher != PREFETCH_NONE || config->classify)
+        sim->numThreads = 1;
+    if (sim->numThreads > (1 << s))
+        sim->numThreads = 1 << s;
+
+    // cache initialization, each thread gets the sets it owns
+    sim->numLocalSets = ((1 << s) + sim->numThreads - 1) / sim->numThreads;
+    sim->threads = calloc(sim->numThreads, sizeof(struct simThread));
+    if (sim->threads == NULL) {
+        free(sim);
+        return NULL;
+    }
+    for (int i = 0; i < sim->numThreads; ++i) {
+        sim->threads[i].cache = calloc((size_t)sim->numLocalSets * E, sizeof(struct cacheLine));
+        if (sim->threads[i].cache == NULL) {
+            cacheSimFree(sim);
+            return NULL;
+        }
+        sim->threads[i].E = E;
+        sim->threads[i].policy = &sim->policy;
+    }
+
+    if (config->prefetcher != PREFETCH_NONE) {
+        sim->pf.kind = config->prefetcher;
+        sim->pf.cache = sim->threads[0].cache;
+        sim->pf.s = s;
+        sim->pf.E = E;
+        sim->pf.b = b;
+        sim->shadow = calloc((size_t)E << s, sizeof(struct cacheLine));
+        if (sim->shadow == NULL) {
+            cacheSimFree(sim);
+            return NULL;
+        }
+    }
+
+    sim->report.classify = config->classify;
+    strcpy(sim->report.regions[0].name, "(other)");
+    if (config->classify) {
+        if (faInit(&sim->report.fa, E << s) < 0) {
+            cacheSimFree(sim);
+            return NULL;
+        }
+        sim->reportFlag = 1;
+    }
+    return sim;
+}
+
+void cacheSimFree(struct cacheSim *sim) {
+    if (sim == NULL)
+        return;
+    for (int i = 0; i < sim->numThreads; ++i) {
+        free(sim->threads[i].cache);
+        free(sim->threads[i].accesses);
+    }
+    free(sim->threads);
+    free(sim->shadow);
+    free(sim->report.fa.nodes);
+    free(sim->report.fa.buckets);
+    free(sim->report.seen.slots);
+    free(sim);
+}
+
+int cacheSimAddRegion(struct cacheSim *sim, const char *name, unsigned long long base, unsigned long long size) {
+    struct missReport *report = &sim->report;
+    if (report->numRegions == MAX_REGIONS)
+        return -1;
+
+    // the catch-all entry stays last
+    struct region *r = &report->regions[report->numRegions++];
+    memset(r, 0, sizeof(struct region) * 2);
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->base = base;
+    r->size = size;
+    strcpy(report->regions[report->numRegions].name, "(other)");
+    sim->reportFlag = 1;
+    return 0;
+}
+
+int cacheSimReadRegions(struct cacheSim *sim, const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    char line[256], name[64];
+    unsigned long long base, size;
+
+    if (fp == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%63s %llx %lli", name, &base, &size) != 3)
+            continue;
+        if (cacheSimAddRegion(sim, name, base, size) < 0)
+            break;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* 
+ * simulateRecord - Run one trace record through the cache and return its
+ *     CACHE_* outcome, or with defer set only queue its block visits on
+ *     the threads owning their sets.
+ */
+static int simulateRecord (struct cacheSim *sim, char operation, unsigned long long address, int size, int defer) {
+    int s = sim->config.s, E = sim->config.E, b = sim->config.b;
+    int isData = operation == 'L' || operation == 'S' || operation == 'M';
+    unsigned long long end = address + (size > 0 ? size : 1);
+    unsigned long long firstBlock = address >> b, lastBlock = (end - 1) >> b;
+    unsigned long long time = sim->time++;
+    int outcome = 0;
+
+    // an access crossing a block boundary touches every block it covers
+    if (isData && lastBlock != firstBlock)
+        ++sim->straddles;
+    if (!sim->config.splitStraddles)
+        lastBlock = firstBlock;
+    if (operation == 'I')
+        sim->pc = address;
+    if (!isData)
+        return 0;
+
+    for (unsigned long long block = firstBlock; block <= lastBlock; ++block) {
+        unsigned long long tag = block >> s;
+        int setIndex = block & ((1 << s) - 1);
+        struct simThread *owner = &sim->threads[setIndex % sim->numThreads];
+        struct cacheLine *cacheSet = &owner->cache[setIndex / sim->numThreads * E];
+        int blockBytes = size;
+        unsigned long long from = block << b, to = (block + 1) << b;
+        unsigned long long blockAddress = address > from ? address : from;
+
+        if (sim->config.splitStraddles)
+            blockBytes = (end < to ? end : to) - blockAddress;
+
+        if (defer) {
+            appendAccess(owner, operation, blockBytes, tag, setIndex / sim->numThreads, time);
+            continue;
+        }
+
+        struct cacheStats *stats = &sim->stats;
+        struct cacheStats before = *stats;
+        if (sim->pf.kind == PREFETCH_NONE)
+            cacheOperate(cacheSet, operation, tag, blockBytes, E, time, &sim->policy, stats, sim->config.verbose);
+        else {
+            prefetchBeforeAccess(&sim->pf, block, time, &sim->policy, stats);
+            before = *stats;
+            unsigned long long shadowMissesBefore = sim->shadowStats.misses;
+            cacheOperate(cacheSet, operation, tag, blockBytes, E, time, &sim->policy, stats, sim->config.verbose);
+            cacheOperate(&sim->shadow[setIndex * E], operation, tag, blockBytes, E, time, &sim->policy, &sim->shadowStats, 0);
+
+            // a miss the cache without prefetching would have hit was caused by a prefetch
+            int missed = stats->misses != before.misses;
+            if (missed && sim->shadowStats.misses == shadowMissesBefore)
+                ++sim->pollution;
+            prefetchAfterAccess(&sim->pf, sim->pc, blockAddress, missed, stats->usefulPrefetches != before.usefulPrefetches, time, &sim->policy, stats);
+        }
+
+        if (stats->hits != before.hits)
+            outcome |= CACHE_HIT;
+        if (stats->misses != before.misses)
+            outcome |= CACHE_MISS;
+        if (stats->evictions != before.evictions)
+            outcome |= CACHE_EVICTION;
+        if (sim->reportFlag)
+            outcome |= attributeAccess(&sim->report, blockAddress, block, &before, stats);
+    }
+    return outcome;
+}
+
+int cacheSimAccess(struct cacheSim *sim, char op, unsigned long long addr, int size) {
+    return simulateRecord(sim, op, addr, size, 0);
+}
+
+void cacheSimBatch(struct cacheSim *sim, const struct cacheAccess *accesses, int n) {
+    // region attribution also needs trace order
+    if (sim->numThreads == 1 || sim->reportFlag) {
+        for (int i = 0; i < n; ++i)
+            simulateRecord(sim, accesses[i].op, accesses[i].addr, accesses[i].size, 0);
+        return;
+    }
+
+    for (int i = 0; i < sim->numThreads; ++i)
+        sim->threads[i].numAccesses = 0;
+    for (int i = 0; i < n; ++i)
+        simulateRecord(sim, accesses[i].op, accesses[i].addr, accesses[i].size, 1);
+
+    int started = 0;
+    for (; started < sim->numThreads; ++started) 
+        if (pthread_create(&sim->threads[started].thread, NULL, simulateStream, &sim->threads[started]) != 0)
+            break;
+    // replay what could not get a thread of its own here
+    for (int i = started; i < sim->numThreads; ++i)
+        simulateStream(&sim->threads[i]);
+    for (int i = 0; i < started; ++i)
+        pthread_join(sim->threads[i].thread, NULL);
+}
+
+void cacheSimStats(struct cacheSim *sim, struct cacheStats *stats) {
+    *stats = sim->stats;
+    for (int i = 0; i < sim->numThreads; ++i) 
+        addStats(stats, &sim->threads[i].stats);
+
+    // lines still dirty at the end would be written back on a flush
+    stats->dirtyLines = 0;
+    for (int i = 0; i < sim->numThreads; ++i) 
+        for (int j = 0; j < sim->numLocalSets * sim->config.E; ++j) 
+            stats->dirtyLines += sim->threads[i].cache[j].valid && sim->threads[i].cache[j].dirty;
+
+    stats->straddles = sim->straddles;
+    stats->pollution = sim->pollution;
+    stats->baselineMisses = sim->pf.kind != PREFETCH_NONE ? sim->shadowStats.misses : stats->misses;
+    stats->compulsory = stats->capacity = stats->conflict = 0;
+    for (int i = 0; i <= sim->report.numRegions; ++i) {
+        stats->compulsory += sim->report.regions[i].compulsory;
+        stats->capacity += sim->report.regions[i].capacity;
+        stats->conflict += sim->report.regions[i].conflict;
+    }
+}
+
+void cacheSimReport(struct cacheSim *sim, FILE *fp) {
+    struct cacheStats stats;
+    cacheSimStats(sim, &stats);
+
+    if (sim->config.reportTraffic)
+        fprintf(fp, "dirty-evictions:%llu dirty-lines:%llu bytes-read:%llu bytes-written:%llu\n",
+                stats.dirtyEvictions, stats.dirtyLines, stats.bytesRead, stats.bytesWritten);
+    if (sim->config.splitStraddles)
+        fprintf(fp, "straddles:%llu\n", stats.straddles);
+    if (sim->pf.kind != PREFETCH_NONE) {
+        fprintf(fp, "prefetches:%llu useful:%llu unused:%llu pollution:%llu baseline-misses:%llu\n",
+                stats.prefetches, stats.usefulPrefetches, stats.unusedPrefetches, stats.pollution, stats.baselineMisses);
+        fprintf(fp, "accuracy:%.2f%% coverage:%.2f%%\n",
+                stats.prefetches ? 100.0 * stats.usefulPrefetches / stats.prefetches : 0.0,
+                stats.baselineMisses ? 100.0 * ((double)stats.baselineMisses - stats.misses) / stats.baselineMisses : 0.0);
+    }
+    for (int i = 0; sim->report.numRegions && i <= sim->report.numRegions; ++i) {
+        struct region *r = &sim->report.regions[i];
+        fprintf(fp, "region %s: hits:%llu misses:%llu evictions:%llu", r->name, r->hits, r->misses, r->evictions);
+        if (sim->report.classify)
+            fprintf(fp, " compulsory:%llu capacity:%llu conflict:%llu", r->compulsory, r->capacity, r->conflict);
+        fprintf(fp, "\n");
+    }
+    if (sim->report.classify)
+        fprintf(fp, "compulsory:%llu capacity:%llu conflict:%llu\n", stats.compulsory, stats.capacity, stats.conflict);
+}
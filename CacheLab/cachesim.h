@@ -0,0 +1,89 @@
+/* 
+ * cachesim.h - Cache simulator library shared by csim, test-trans and
+ *     tracegen, so tools simulate in-process instead of spawning csim.
+ *
+ * The cache has 2^s sets of E lines with 2^b byte blocks and LRU
+ * replacement. Accesses use valgrind lackey operations: 'L' load,
+ * 'S' store, 'M' modify (load then store) and 'I' instruction fetch,
+ * which is not simulated but supplies the PC for the stride prefetcher.
+ */
+
+#ifndef CACHELAB_CACHESIM_H
+#define CACHELAB_CACHESIM_H
+
+#include <stdio.h>
+
+/* Prefetcher models, only simulated serially since they cross set boundaries */
+#define PREFETCH_NONE 0
+#define PREFETCH_NEXT 1     /* tagged next-line: on a miss or first use of a prefetched block */
+#define PREFETCH_STRIDE 2   /* per-PC stride detection, PCs come from the 'I' trace records */
+#define PREFETCH_STREAM 3   /* Jouppi stream buffers beside the cache */
+
+struct cacheConfig {
+    int s, E, b;
+    int writeThrough;       /* stores update memory immediately instead of on eviction */
+    int noWriteAllocate;    /* store misses bypass the cache */
+    int splitStraddles;     /* accesses crossing blocks visit every block they cover */
+    int prefetcher;         /* one of PREFETCH_* */
+    int classify;           /* classify misses as compulsory, capacity or conflict */
+    int numThreads;         /* threads used by cacheSimBatch(), 0 or 1 is serial */
+    int verbose;            /* print the outcome of every access to stdout */
+    int reportTraffic;      /* include memory traffic in cacheSimReport() */
+};
+
+struct cacheStats {
+    unsigned long long hits, misses, evictions;
+    unsigned long long dirtyEvictions;
+    unsigned long long dirtyLines;          /* lines still dirty, written back on a flush */
+    unsigned long long bytesRead, bytesWritten;    /* traffic to and from memory */
+    unsigned long long straddles;           /* data accesses that cross a block boundary */
+    unsigned long long prefetches;          /* blocks fetched by the prefetcher */
+    unsigned long long usefulPrefetches;    /* prefetched blocks later hit by a demand access */
+    unsigned long long unusedPrefetches;    /* prefetched blocks dropped before any use */
+    unsigned long long pollution;           /* misses caused by prefetches evicting live blocks */
+    unsigned long long baselineMisses;      /* misses of the same cache without prefetching */
+    unsigned long long compulsory, capacity, conflict;
+};
+
+/* What cacheSimAccess() did, a modify or a split straddle can do several */
+#define CACHE_HIT 0x01
+#define CACHE_MISS 0x02
+#define CACHE_EVICTION 0x04
+#define CACHE_COMPULSORY 0x08    /* miss classes, only when classifying */
+#define CACHE_CAPACITY 0x10
+#define CACHE_CONFLICT 0x20
+
+/* One trace record, as read from a lackey trace */
+struct cacheAccess {
+    char op;
+    int size;
+    unsigned long long addr;
+};
+
+struct cacheSim;
+
+/* Create an empty cache, returns NULL if the configuration is invalid */
+struct cacheSim *cacheSimCreate(const struct cacheConfig *config);
+
+void cacheSimFree(struct cacheSim *sim);
+
+/* Attribute accesses within [base, base + size) to a named region */
+int cacheSimAddRegion(struct cacheSim *sim, const char *name, 
+                      unsigned long long base, unsigned long long size);
+
+/* Add the "name base size" regions listed in a file, base in hex */
+int cacheSimReadRegions(struct cacheSim *sim, const char *filename);
+
+/* Simulate a single access, returns its CACHE_* outcome */
+int cacheSimAccess(struct cacheSim *sim, char op, unsigned long long addr, int size);
+
+/* Simulate accesses in order, on numThreads threads when possible */
+void cacheSimBatch(struct cacheSim *sim, const struct cacheAccess *accesses, int n);
+
+/* Collect the statistics of everything simulated so far */
+void cacheSimStats(struct cacheSim *sim, struct cacheStats *stats);
+
+/* Print the statistics the configuration asked for beyond hits, misses and evictions */
+void cacheSimReport(struct cacheSim *sim, FILE *fp);
+
+#endif /* CACHELAB_CACHESIM_H */
@@ -2,85 +2,90 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "cachelab.h"
+#include "cachesim.h"
+#include "tracefile.h"
 
-struct cacheLine {
-    int valid;
-    unsigned long long tag;
-    int lastUsedTime;
-};
-
-void cacheVisit (struct cacheLine *cacheSet, unsigned long long tag, int E, int time, int *pHit, int *pMiss, int *pEviction, int verboseFlag) {
-    int vacantLineIndex = -1;
-    for (int i = 0; i < E; ++i) {
-        if (cacheSet[i].valid) {
-            if (cacheSet[i].tag == tag) {
-                ++(*pHit);
-                cacheSet[i].lastUsedTime = time;
-
-                if (verboseFlag)
-                    printf(" hit");
-                return;
-            }
-        } else 
-            vacantLineIndex = i;
-    }
-
-    ++(*pMiss);
-    if (verboseFlag)
-        printf(" miss");    
-    if (vacantLineIndex != -1) {
-        cacheSet[vacantLineIndex].valid = 1;
-        cacheSet[vacantLineIndex].tag = tag;
-        cacheSet[vacantLineIndex].lastUsedTime = time;
-        return;
-    }
-
-    ++(*pEviction);
-    if (verboseFlag)
-        printf(" eviction");
-    int minIndex = -1, minTime = 0x7fffffff;
-    for (int i = 0; i < E; ++i) {
-        if (cacheSet[i].lastUsedTime < minTime) {
-            minIndex = i;
-            minTime = cacheSet[i].lastUsedTime;
-        }
-    }
-    cacheSet[minIndex].tag = tag;
-    cacheSet[minIndex].lastUsedTime = time;
-
-    return;
-}
+/* Trace records handed to the simulator at once in parallel mode */
+#define BATCH_SIZE (1 << 20)
 
 int main(int argc, char **argv) {
     // get cache args from command-line args and open file
     int opt;
-    int helpFlag, verboseFlag;
-    int s, E, b;
-    FILE *traceFile;
-    while ((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1) {
+    int helpFlag = 0, verboseFlag = 0;
+    struct cacheConfig config = {0};
+    char *regionFile = NULL;
+    struct traceFile *traceFile = NULL;
+    while ((opt = getopt(argc, argv, "hvxcs:E:b:t:j:W:A:p:r:")) != -1) {
         switch (opt) {
             case 'h':
                 helpFlag = 1;
                 break;
             case 'v':
-                verboseFlag = 1;
+                config.verbose = verboseFlag = 1;
+                break;
+            case 'x':
+                config.splitStraddles = 1;
+                break;
+            case 'c':
+                config.classify = 1;
+                break;
+            case 'r':
+                regionFile = optarg;
                 break;
             case 's':
-                s = atoi(optarg);
+                config.s = atoi(optarg);
                 break;
             case 'E':
-                E = atoi(optarg);
+                config.E = atoi(optarg);
                 break;
             case 'b':
-                b = atoi(optarg);
+                config.b = atoi(optarg);
                 break;
             case 't':
-                traceFile = fopen(optarg, "r");
+                traceFile = traceFileOpen(optarg);
+                break;
+            case 'j':
+                config.numThreads = atoi(optarg);
+                break;
+            case 'W':
+                if (!strcmp(optarg, "wb"))
+                    config.writeThrough = 0;
+                else if (!strcmp(optarg, "wt"))
+                    config.writeThrough = 1;
+                else {
+                    printf("Unknown write policy %s, expected wb or wt\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.reportTraffic = 1;
+                break;
+            case 'A':
+                if (!strcmp(optarg, "wa"))
+                    config.noWriteAllocate = 0;
+                else if (!strcmp(optarg, "nwa"))
+                    config.noWriteAllocate = 1;
+                else {
+                    printf("Unknown allocation policy %s, expected wa or nwa\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                config.reportTraffic = 1;
+                break;
+            case 'p':
+                if (!strcmp(optarg, "next"))
+                    config.prefetcher = PREFETCH_NEXT;
+                else if (!strcmp(optarg, "stride"))
+                    config.prefetcher = PREFETCH_STRIDE;
+                else if (!strcmp(optarg, "stream"))
+                    config.prefetcher = PREFETCH_STREAM;
+                else {
+                    printf("Unknown prefetcher %s, expected next, stride or stream\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
                 break;
             default:
-                printf("Usage: ./csim [-hv] -s <s> -E <E> -b <b> -t <tracefile>");
+                printf("Usage: ./csim [-hvxc] [-j <num>] [-W wb|wt] [-A wa|nwa] [-p <kind>] [-r <file>] -s <s> -E <E> -b <b> -t <tracefile>");
                 exit(EXIT_FAILURE);
        }
     }
@@ -88,67 +93,91 @@ int main(int argc, char **argv) {
     // display help info and exit
     if (helpFlag) {
         printf(
-            "Usage: ./csim [-hv] -s <num> -E <num> -b <num> -t <file>\n"
+            "Usage: ./csim [-hvxc] [-j <num>] [-W wb|wt] [-A wa|nwa] [-p <kind>] [-r <file>] -s <num> -E <num> -b <num> -t <file>\n"
             "Options:\n"
             "-h         Print this help message.\n"
             "-v         Optional verbose flag.\n"
+            "-x         Split accesses that straddle blocks into per-block visits.\n"
+            "-c         Classify misses as compulsory, capacity or conflict.\n"
             "-s <num>   Number of set index bits.\n"
             "-E <num>   Number of lines per set.\n"
             "-b <num>   Number of block offset bits.\n"
-            "-t <file>  Trace file.\n"
+            "-t <file>  Trace file, text or binary (see tracepack).\n"
+            "-j <num>   Simulate disjoint groups of sets on <num> threads.\n"
+            "-W <pol>   Write-back (wb, default) or write-through (wt) stores.\n"
+            "-A <pol>   Write-allocate (wa, default) or no-write-allocate (nwa).\n"
+            "           Either option also reports dirty evictions and memory traffic.\n"
+            "-p <kind>  Simulate a next, stride (per-PC) or stream prefetcher.\n"
+            "-r <file>  Attribute misses to the \"name base size\" ranges in <file>.\n"
             "\n"
             "Examples:\n"
             "linux>  ./csim -s 4 -E 1 -b 4 -t traces/yi.trace\n"
             "linux>  ./csim -v -s 8 -E 2 -b 4 -t traces/yi.trace\n" 
+            "linux>  ./csim -j 4 -s 5 -E 1 -b 5 -t traces/long.trace\n" 
+            "linux>  ./csim -W wt -A nwa -s 5 -E 1 -b 5 -t traces/long.trace\n" 
+            "linux>  ./csim -p stride -s 5 -E 1 -b 5 -t traces/long.trace\n" 
+            "linux>  ./csim -c -r .regions -s 5 -E 1 -b 5 -t trace.f0\n" 
+            "linux>  ./tracepack traces/long.trace long.bin && ./csim -s 5 -E 1 -b 5 -t long.bin\n" 
         );
 
         return 1;
     }
 
-    // cache initialization
-    struct cacheLine cache[1 << s][E];
-    for (int i = 0; i < (1 << s); ++i) 
-        for (int j = 0; j < E; ++j) 
-            cache[i][j].valid = 0;
-    
+    if (traceFile == NULL) {
+        printf("Unable to open trace file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct cacheSim *sim = cacheSimCreate(&config);
+    if (sim == NULL) {
+        printf("Invalid cache parameters\n");
+        exit(EXIT_FAILURE);
+    }
+    if (regionFile && cacheSimReadRegions(sim, regionFile) < 0) {
+        printf("Unable to open region map %s\n", regionFile);
+        exit(EXIT_FAILURE);
+    }
+
+    // in parallel mode records are handed over in batches
+    struct cacheAccess *batch = malloc(BATCH_SIZE * sizeof(struct cacheAccess));
+    int batchSize = 0;
+
+    struct cacheAccess access;
     char operation;
     unsigned long long address;
     int size;
-    
-    // time and counters initialization
-    int time = 0, hits = 0, misses = 0, evictions = 0;
 
     // simulation over tracefile input
-    while (fscanf(traceFile, "%c %llx, %d\n", &operation, &address, &size) > 0) {
-        unsigned long long tag = address >> (b + s);
-        int setIndex = (address >> b) & ((1 << s) - 1);
+    while (traceFileRead(traceFile, &access)) {
+        operation = access.op;
+        address = access.addr;
+        size = access.size;
+        if (config.numThreads > 1 && !verboseFlag) {
+            batch[batchSize] = access;
+            if (++batchSize == BATCH_SIZE) {
+                cacheSimBatch(sim, batch, batchSize);
+                batchSize = 0;
+            }
+            continue;
+        }
 
         if (verboseFlag) 
             printf("%c %llx, %d", operation, address, size);
-                
-        switch (operation) {
-            case 'I':
-                break;
-            case 'L':
-                cacheVisit(cache[setIndex], tag, E, time, &hits, &misses, &evictions, verboseFlag);
-                break;
-            case 'S':
-                cacheVisit(cache[setIndex], tag, E, time, &hits, &misses, &evictions, verboseFlag); 
-                break;
-            case 'M':
-                cacheVisit(cache[setIndex], tag, E, time, &hits, &misses, &evictions, verboseFlag);
-                ++hits;
-                if (verboseFlag)
-                    printf(" hit");
-                break;
-        }
-
+        cacheSimAccess(sim, operation, address, size);
         if (verboseFlag)
             printf("\n");
-        ++time;
     }
-    fclose(traceFile);
+    if (traceFileClose(traceFile) < 0) {
+        printf("Trace file is corrupt\n");
+        exit(EXIT_FAILURE);
+    }
+    cacheSimBatch(sim, batch, batchSize);
+    free(batch);
 
-    printSummary(hits, misses, evictions);
+    struct cacheStats stats;
+    cacheSimStats(sim, &stats);
+    printSummary(stats.hits, stats.misses, stats.evictions);
+    cacheSimReport(sim, stdout);
+    cacheSimFree(sim);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,146 @@
+/*
+ * kernels.c - Matrix kernels other than transpose, evaluated by
+ *     test-trans -k <kind> with the same simulated cache as trans.c
+ *
+ * Each kernel must have the prototype of its kind (see cachelab.h):
+ * void mm(int M, int N, int K, int A[N][K], int B[K][M], int C[N][M]);
+ * void stencil(int M, int N, int A[N][M], int C[N][M]);
+ * void conv(int M, int N, int K, int A[N][M], int B[K][K], int C[N-K+1][M-K+1]);
+ *
+ * Like trans.c this file is compiled with -fsanitize=thread, so every
+ * access a kernel makes to the matrices is simulated.
+ */
+#include <stdio.h>
+
+#include "cachelab.h"
+
+#define BLOCKSIZE 8
+
+/*
+ * mm_naive - Inner products, walking B down its columns
+ */
+char mm_naive_desc[] = "Naive ijk multiply";
+void mm_naive(int M, int N, int K, int A[N][K], int B[K][M], int C[N][M]) {
+    int i, j, k, sum;
+
+    for (i = 0; i < N; ++i) {
+        for (j = 0; j < M; ++j) {
+            sum = 0;
+            for (k = 0; k < K; ++k)
+                sum += A[i][k] * B[k][j];
+            C[i][j] = sum;
+        }
+    }
+}
+
+/*
+ * mm_blocked - ikj order inside BLOCKSIZE tiles of k and j, so rows of
+ *     B and C are streamed and a tile of B is reused by every row of A
+ */
+char mm_blocked_desc[] = "Blocked ikj multiply";
+void mm_blocked(int M, int N, int K, int A[N][K], int B[K][M], int C[N][M]) {
+    int i, j, k, kk, jj, a;
+
+    for (i = 0; i < N; ++i)
+        for (j = 0; j < M; ++j)
+            C[i][j] = 0;
+
+    for (kk = 0; kk < K; kk += BLOCKSIZE)
+        for (jj = 0; jj < M; jj += BLOCKSIZE)
+            for (i = 0; i < N; ++i)
+                for (k = kk; k < kk + BLOCKSIZE && k < K; ++k) {
+                    a = A[i][k];
+                    for (j = jj; j < jj + BLOCKSIZE && j < M; ++j)
+                        C[i][j] += a * B[k][j];
+                }
+}
+
+/*
+ * stencil_rows - 5-point stencil, row by row
+ */
+char stencil_rows_desc[] = "Row-wise 5-point stencil";
+void stencil_rows(int M, int N, int A[N][M], int C[N][M]) {
+    int i, j;
+
+    for (i = 0; i < N; ++i) {
+        for (j = 0; j < M; ++j) {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                C[i][j] = A[i][j];
+            else
+                C[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+        }
+    }
+}
+
+/*
+ * stencil_cols - 5-point stencil, column by column
+ */
+char stencil_cols_desc[] = "Column-wise 5-point stencil";
+void stencil_cols(int M, int N, int A[N][M], int C[N][M]) {
+    int i, j;
+
+    for (j = 0; j < M; ++j) {
+        for (i = 0; i < N; ++i) {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                C[i][j] = A[i][j];
+            else
+                C[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+        }
+    }
+}
+
+/*
+ * conv_direct - Each output is the dot product of the filter with the
+ *     K x K window of A under it
+ */
+char conv_direct_desc[] = "Direct convolution";
+void conv_direct(int M, int N, int K, int A[N][M], int B[K][K], int C[N-K+1][M-K+1]) {
+    int i, j, u, v, sum;
+
+    for (i = 0; i < N - K + 1; ++i) {
+        for (j = 0; j < M - K + 1; ++j) {
+            sum = 0;
+            for (u = 0; u < K; ++u)
+                for (v = 0; v < K; ++v)
+                    sum += A[i + u][j + v] * B[u][v];
+            C[i][j] = sum;
+        }
+    }
+}
+
+/*
+ * conv_rows - For each output row, add in one filter tap at a time
+ *     across the whole row, streaming rows of A instead of windows
+ */
+char conv_rows_desc[] = "Row-streaming convolution";
+void conv_rows(int M, int N, int K, int A[N][M], int B[K][K], int C[N-K+1][M-K+1]) {
+    int i, j, u, v, b;
+
+    for (i = 0; i < N - K + 1; ++i) {
+        for (j = 0; j < M - K + 1; ++j)
+            C[i][j] = 0;
+        for (u = 0; u < K; ++u) {
+            for (v = 0; v < K; ++v) {
+                b = B[u][v];
+                for (j = 0; j < M - K + 1; ++j)
+                    C[i][j] += A[i + u][j + v] * b;
+            }
+        }
+    }
+}
+
+/*
+ * registerKernels - This function registers your kernels with the
+ *     driver, which evaluates those of the kind it is asked for.
+ */
+void registerKernels()
+{
+    registerMMFunction(mm_naive, mm_naive_desc);
+    registerMMFunction(mm_blocked, mm_blocked_desc);
+
+    registerStencilFunction(stencil_rows, stencil_rows_desc);
+    registerStencilFunction(stencil_cols, stencil_cols_desc);
+
+    registerConvFunction(conv_direct, conv_direct_desc);
+    registerConvFunction(conv_rows, conv_rows_desc);
+}
@@ -0,0 +1,479 @@
+/*
+ * rdprof.c - Reuse-distance and conflict profiler for transpose traces
+ *
+ * Reads a lackey trace such as the ones tracegen -t writes, as text or
+ * packed by tracepack, and prints
+ *
+ *  - a histogram of reuse distances: for every access, the number of
+ *    distinct blocks touched since the previous access to its block. An
+ *    LRU cache of C blocks hits exactly the accesses with distance < C,
+ *    whatever its associativity would add in conflicts.
+ *
+ *  - heatmaps of A and B, located through the .regions file tracegen
+ *    writes, shading every element (or group of elements, for matrices
+ *    wider than MAX_CELLS) by the conflict misses of accesses to it on
+ *    the simulated cache, with per-row and per-column miss totals.
+ *
+ * Distances are counted with a Fenwick tree over trace positions that
+ * holds a 1 at the latest access to each block, so the distance of an
+ * access is the sum over the positions since that block's last access.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cachesim.h"
+#include "tracefile.h"
+
+/* Heatmaps are at most this many characters wide and tall */
+#define MAX_CELLS 64
+
+/* Histogram buckets: cold, 0, then powers of two up to 2^(MAX_BUCKETS-3) */
+#define MAX_BUCKETS 34
+
+/* Shades from no conflict misses to the most in any cell */
+static const char shades[] = " .:-=+*#%@";
+
+struct access {
+    unsigned long long addr;
+    char op;
+};
+
+/* A matrix found in the regions file and its miss counts */
+struct matrix {
+    char name[16];
+    unsigned long long base, size;
+    int rows, cols;
+    int *rowMisses, *rowConflicts;
+    int *colMisses, *colConflicts;
+    int *cells;                 /* conflict misses per heatmap cell */
+    int cellRows, cellCols;     /* elements per cell, down and across */
+    long long hist[MAX_BUCKETS];
+};
+
+/* Globals set on the command line */
+static int M = 0;
+static int N = 0;
+static struct cacheConfig config;
+static int verbose = 0;
+
+/* The trace, read whole since the Fenwick tree is sized by its length */
+static struct access *trace;
+static long numAccesses = 0;
+
+/* Fenwick tree over trace positions 1..numAccesses */
+static int *fenwick;
+
+/* Open-addressed map from block to the position of its last access */
+static unsigned long long *blockKeys;
+static long *blockLast;
+static long blockCap = 0, blockCount = 0;
+
+static struct matrix matrices[2];
+static long long totalHist[MAX_BUCKETS];
+
+/*
+ * fenwick_add - Add delta at trace position pos
+ */
+static void fenwick_add(long pos, int delta)
+{
+    for (; pos <= numAccesses; pos += pos & -pos)
+        fenwick[pos] += delta;
+}
+
+/*
+ * fenwick_sum - Sum of the trace positions 1..pos
+ */
+static long fenwick_sum(long pos)
+{
+    long sum = 0;
+
+    for (; pos > 0; pos -= pos & -pos)
+        sum += fenwick[pos];
+    return sum;
+}
+
+/*
+ * block_slot - Slot of block in the map, empty if it was never seen
+ */
+static long block_slot(unsigned long long block)
+{
+    long i = (long)((block * 0x9E3779B97F4A7C15ULL) >> 20) & (blockCap - 1);
+
+    while (blockLast[i] && blockKeys[i] != block)
+        i = (i + 1) & (blockCap - 1);
+    return i;
+}
+
+/*
+ * block_grow - Double the map once it is half full
+ */
+static void block_grow(void)
+{
+    unsigned long long *oldKeys = blockKeys;
+    long *oldLast = blockLast;
+    long oldCap = blockCap, i, j;
+
+    blockCap = blockCap ? blockCap * 2 : 1024;
+    blockKeys = calloc(blockCap, sizeof(*blockKeys));
+    blockLast = calloc(blockCap, sizeof(*blockLast));
+    if (!blockKeys || !blockLast) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < oldCap; i++) {
+        if (!oldLast[i])
+            continue;
+        j = block_slot(oldKeys[i]);
+        blockKeys[j] = oldKeys[i];
+        blockLast[j] = oldLast[i];
+    }
+    free(oldKeys);
+    free(oldLast);
+}
+
+/*
+ * bucket - Histogram bucket of a reuse distance, -1 being cold
+ */
+static int bucket(long distance)
+{
+    int k = 2;
+
+    if (distance < 0)
+        return 0;
+    if (distance == 0)
+        return 1;
+    while (distance > 1 && k < MAX_BUCKETS - 1) {
+        distance >>= 1;
+        k++;
+    }
+    return k;
+}
+
+/*
+ * read_trace - Load every data access of a lackey trace, splitting
+ *     modifies into their load and store
+ */
+static void read_trace(const char *filename)
+{
+    struct traceFile *tf = traceFileOpen(filename);
+    struct cacheAccess access;
+    long cap = 1 << 16;
+
+    if (!tf) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        exit(1);
+    }
+    trace = malloc(cap * sizeof(*trace));
+    while (trace && traceFileRead(tf, &access)) {
+        // also drops the empty record before a text trace's leading blank
+        if (access.op != 'L' && access.op != 'S' && access.op != 'M')
+            continue;
+        if (numAccesses + 2 > cap) {
+            cap *= 2;
+            trace = realloc(trace, cap * sizeof(*trace));
+            if (!trace)
+                break;
+        }
+        trace[numAccesses].addr = access.addr;
+        trace[numAccesses++].op = access.op == 'S' ? 'S' : 'L';
+        if (access.op == 'M') {
+            trace[numAccesses].addr = access.addr;
+            trace[numAccesses++].op = 'S';
+        }
+    }
+    if (traceFileClose(tf) < 0) {
+        fprintf(stderr, "%s is corrupt\n", filename);
+        exit(1);
+    }
+    if (!trace) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+}
+
+/*
+ * read_regions - Find A (N x M) and B (M x N) in a tracegen regions file
+ */
+static void read_regions(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    char name[16];
+    unsigned long long base, size;
+    struct matrix *mat;
+    int i;
+
+    if (!fp) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        exit(1);
+    }
+    while (fscanf(fp, "%15s %llx %llu", name, &base, &size) == 3) {
+        if (strcmp(name, "A") && strcmp(name, "B"))
+            continue;
+        mat = &matrices[name[0] - 'A'];
+        strcpy(mat->name, name);
+        mat->base = base;
+        mat->size = size;
+    }
+    fclose(fp);
+
+    for (i = 0; i < 2; i++) {
+        mat = &matrices[i];
+        if (!mat->size) {
+            fprintf(stderr, "%s lists no matrix %c\n", filename, 'A' + i);
+            exit(1);
+        }
+        mat->rows = i ? M : N;
+        mat->cols = i ? N : M;
+        mat->cellRows = (mat->rows + MAX_CELLS - 1) / MAX_CELLS;
+        mat->cellCols = (mat->cols + MAX_CELLS - 1) / MAX_CELLS;
+        mat->rowMisses = calloc(mat->rows, sizeof(int));
+        mat->rowConflicts = calloc(mat->rows, sizeof(int));
+        mat->colMisses = calloc(mat->cols, sizeof(int));
+        mat->colConflicts = calloc(mat->cols, sizeof(int));
+        mat->cells = calloc(MAX_CELLS * MAX_CELLS, sizeof(int));
+        if (!mat->rowMisses || !mat->rowConflicts || !mat->colMisses
+            || !mat->colConflicts || !mat->cells) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+}
+
+/*
+ * find_matrix - The matrix holding addr, or NULL
+ */
+static struct matrix *find_matrix(unsigned long long addr)
+{
+    int i;
+
+    for (i = 0; i < 2; i++)
+        if (addr >= matrices[i].base && addr - matrices[i].base < matrices[i].size)
+            return &matrices[i];
+    return NULL;
+}
+
+/*
+ * profile - Measure the reuse distance and simulate every access
+ */
+static void profile(void)
+{
+    struct cacheSim *sim;
+    struct cacheStats stats;
+    struct matrix *mat;
+    unsigned long long block;
+    long t, slot, distance, element;
+    int row, col, k, outcome;
+
+    config.classify = 1;
+    sim = cacheSimCreate(&config);
+    fenwick = calloc(numAccesses + 1, sizeof(int));
+    if (!sim || !fenwick) {
+        fprintf(stderr, "Invalid cache or out of memory\n");
+        exit(1);
+    }
+    block_grow();
+
+    for (t = 1; t <= numAccesses; t++) {
+        block = trace[t - 1].addr >> config.b;
+
+        /* Distinct blocks whose latest access lies strictly between */
+        slot = block_slot(block);
+        if (blockLast[slot]) {
+            distance = fenwick_sum(t - 1) - fenwick_sum(blockLast[slot]);
+            fenwick_add(blockLast[slot], -1);
+        } else {
+            distance = -1;
+            blockKeys[slot] = block;
+            blockCount++;
+        }
+        blockLast[slot] = t;
+        fenwick_add(t, 1);
+        if (2 * blockCount > blockCap)
+            block_grow();
+
+        outcome = cacheSimAccess(sim, trace[t - 1].op, trace[t - 1].addr, 1);
+
+        k = bucket(distance);
+        totalHist[k]++;
+        mat = find_matrix(trace[t - 1].addr);
+        if (mat) {
+            mat->hist[k]++;
+            element = (trace[t - 1].addr - mat->base) / sizeof(int);
+            row = element / mat->cols;
+            col = element % mat->cols;
+            if (outcome & CACHE_MISS) {
+                mat->rowMisses[row]++;
+                mat->colMisses[col]++;
+            }
+            if (outcome & CACHE_CONFLICT) {
+                mat->rowConflicts[row]++;
+                mat->colConflicts[col]++;
+                mat->cells[row / mat->cellRows * MAX_CELLS + col / mat->cellCols]++;
+            }
+        }
+    }
+
+    cacheSimStats(sim, &stats);
+    printf("Profiled %ld accesses to %ld blocks: hits:%llu misses:%llu compulsory:%llu capacity:%llu conflict:%llu\n",
+           numAccesses, blockCount, stats.hits, stats.misses,
+           stats.compulsory, stats.capacity, stats.conflict);
+    cacheSimFree(sim);
+}
+
+/*
+ * print_histogram - Reuse distance histogram, all accesses and per matrix
+ */
+static void print_histogram(void)
+{
+    long capacity = (long)config.E << config.s;
+    long lo;
+    int k, last = 0;
+
+    for (k = 0; k < MAX_BUCKETS; k++)
+        if (totalHist[k])
+            last = k;
+
+    printf("\nReuse distances in %d-byte blocks (* at or beyond the %ld-block capacity)\n",
+           1 << config.b, capacity);
+    printf("%-16s %10s %10s %10s\n", "distance", "all", "A", "B");
+    for (k = 0; k <= last; k++) {
+        char label[32];
+
+        lo = k < 2 ? 0 : 1L << (k - 2);
+        if (k == 0)
+            strcpy(label, "cold");
+        else if (k == 1)
+            strcpy(label, "0");
+        else if (k == MAX_BUCKETS - 1)
+            sprintf(label, "%ld+", lo);
+        else if (lo == 1)
+            strcpy(label, "1");
+        else
+            sprintf(label, "%ld-%ld", lo, 2 * lo - 1);
+        printf("%-14s %c %10lld %10lld %10lld\n", label,
+               k > 0 && lo >= capacity ? '*' : ' ',
+               totalHist[k], matrices[0].hist[k], matrices[1].hist[k]);
+    }
+}
+
+/*
+ * print_heatmap - Shade the conflict misses of one matrix, with its
+ *     row totals alongside and, if verbose, its column totals below
+ */
+static void print_heatmap(const struct matrix *mat)
+{
+    int height = (mat->rows + mat->cellRows - 1) / mat->cellRows;
+    int width = (mat->cols + mat->cellCols - 1) / mat->cellCols;
+    int top = 0, i, j, r, misses, conflicts;
+    int levels = (int)sizeof(shades) - 2;
+
+    for (i = 0; i < MAX_CELLS * MAX_CELLS; i++)
+        if (mat->cells[i] > top)
+            top = mat->cells[i];
+
+    printf("\nConflict misses in %s (%d x %d", mat->name, mat->rows, mat->cols);
+    if (mat->cellRows > 1 || mat->cellCols > 1)
+        printf(", %d x %d elements per cell", mat->cellRows, mat->cellCols);
+    if (top)
+        printf(", '%c' is %d)\n", shades[levels], top);
+    else
+        printf(", none)\n");
+
+    for (i = 0; i < height; i++) {
+        misses = conflicts = 0;
+        for (r = i * mat->cellRows; r < (i + 1) * mat->cellRows && r < mat->rows; r++) {
+            misses += mat->rowMisses[r];
+            conflicts += mat->rowConflicts[r];
+        }
+        printf("row %4d |", i * mat->cellRows);
+        for (j = 0; j < width; j++) {
+            int c = mat->cells[i * MAX_CELLS + j];
+            // cells without conflicts stay blank, even when none has any
+            putchar(shades[c ? ((long)c * levels + top - 1) / top : 0]);
+        }
+        printf("| misses:%d conflict:%d\n", misses, conflicts);
+    }
+
+    if (verbose) {
+        for (j = 0; j < mat->cols; j++)
+            printf("col %4d misses:%d conflict:%d\n", j, mat->colMisses[j], mat->colConflicts[j]);
+    }
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[])
+{
+    printf("Usage: %s [-hv] [-r <regions>] -M <cols> -N <rows> -s <s> -E <E> -b <b> -t <tracefile>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -v          Also print the misses of every column.\n");
+    printf("  -r <file>   Where A and B live (default .regions, from tracegen).\n");
+    printf("  -M <cols>   Number of matrix columns of A\n");
+    printf("  -N <rows>   Number of matrix rows of A\n");
+    printf("  -s, -E, -b  Cache geometry, as for csim\n");
+    printf("  -t <file>   Trace to profile, as text or from tracepack\n");
+    printf("Example: ./tracegen -M 64 -N 64 -F 0 -t trace.f0\n");
+    printf("         %s -M 64 -N 64 -s 5 -E 1 -b 5 -t trace.f0\n", argv[0]);
+}
+
+/*
+ * main - Profile a trace and print its histogram and heatmaps
+ */
+int main(int argc, char *argv[])
+{
+    char *traceFile = NULL, *regionFile = ".regions";
+    char c;
+
+    config.s = config.E = config.b = -1;
+    while ((c = getopt(argc, argv, "M:N:s:E:b:t:r:vh")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 's':
+            config.s = atoi(optarg);
+            break;
+        case 'E':
+            config.E = atoi(optarg);
+            break;
+        case 'b':
+            config.b = atoi(optarg);
+            break;
+        case 't':
+            traceFile = optarg;
+            break;
+        case 'r':
+            regionFile = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (M <= 0 || N <= 0 || config.s < 0 || config.E < 1 || config.b < 0 || !traceFile) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    read_regions(regionFile);
+    read_trace(traceFile);
+    profile();
+    print_histogram();
+    print_heatmap(&matrices[0]);
+    print_heatmap(&matrices[1]);
+    return 0;
+}
@@ -1,8 +1,16 @@
 /*
  * test-trans.c - Checks the correctness and performance of all of the
  *     student's transpose functions and records the results for their
- *     official submitted version as well.
+ *     official submitted version as well. The functions are linked in
+ *     compiled with -fsanitize=thread, whose load/store hooks (see
+ *     tracehook.c) feed the cache simulator library in-process.
+ *     With -w it instead times the vectorized kernels of trans-simd.c
+ *     against scalar ones on a matrix of any size, and with -i it
+ *     evaluates the in-place kernels of trans-inplace.c. With -k it
+ *     evaluates the multiply, stencil or convolution kernels registered
+ *     in kernels.c the same way as the transposes.
  */
+#define _POSIX_C_SOURCE 200809L /* for clock_gettime */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -11,8 +19,13 @@
 #include <signal.h>
 #include <getopt.h>
 #include <sys/types.h>
+#include <time.h>
 #include "cachelab.h"
-#include <sys/wait.h> // fir WEXITSTATUS
+#include "trans-simd.h"
+#include "trans-par.h"
+#include "trans-inplace.h"
+#include "tracehook.h"
+#include "cachesim.h"
 #include <limits.h> // for INT_MAX
 
 /* Maximum array dimension */
@@ -25,13 +38,23 @@
 /* External function defined in trans.c */
 extern void registerFunctions();
 
+/* External function defined in kernels.c */
+extern void registerKernels();
+
 /* External variables defined in cachelab-tools.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
+extern kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+extern int kernel_counter;
 
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int wallclock = 0;
+static int threads = 0;
+static int inplace = 0;
+static int kind = -1;   /* KERNEL_* given with -k, -1 for transpose */
+static int K = 0;
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -41,22 +64,56 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/* The matrices every registered function is traced on */
+static int A[MAXN][MAXN];
+static int B[MAXN][MAXN];
+static int C[MAXN][MAXN];   /* output of the other kernel kinds */
+
+/* Simulated cache of the function being evaluated */
+static struct cacheSim* sim;
+
+/*
+ * simulate_access - Trace sink, feeds one access to the simulator
+ */
+void simulate_access(char op, unsigned long long addr, int size)
+{
+    cacheSimAccess(sim, op, addr, size);
+}
+
+/*
+ * validate - Check that B holds the transpose of A
+ */
+int validate(int fn, int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            if (A[i][j] != B[j][i]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",
+                       fn, A[i][j], B[j][i], j, i);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    int i;
+    unsigned int hits, misses, evictions;
+    struct cacheConfig config = {0};
+    struct cacheStats stats;
 
     registerFunctions(); 
 
-    /* Open the complete trace file */
-    FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
+    /* Only accesses to the two matrices are traced */
+    traceAddRegion(A, N * M * sizeof(int));
+    traceAddRegion(B, M * N * sizeof(int));
 
     /* Evaluate the performance of each registered transpose function */
 
@@ -65,23 +122,25 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.funcid = i; /* remember which function is the submission */
 
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+        printf("\nFunction %d (%d total)\nStep 1: Validating and simulating memory accesses\n",i,func_counter);
+
+        /* The trans functions are instrumented, so calling one simulates it */
+        config.s = s;
+        config.E = E;
+        config.b = b;
+        sim = cacheSimCreate(&config);
+        assert(sim);
+        initMatrix(M, N, A, B);
+        traceStart(simulate_access);
+        (*func_list[i].func_ptr)(M, N, A, B);
+        traceStop();
 
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
+        if (!validate(i, M, N, A, B)) {
+            printf("Validation error at function %d!\nSkipping performance evaluation for this function.\n", i);
+            cacheSimFree(sim);
             continue;
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
-
         func_list[i].correct=1;
 
         /* Save the correctness of the transpose submission */
@@ -89,63 +148,13 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
+        /* Collect results from the simulator */
         printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
+        cacheSimStats(sim, &stats);
+        cacheSimFree(sim);
+        hits = stats.hits;
+        misses = stats.misses;
+        evictions = stats.evictions;
         func_list[i].num_hits = hits;
         func_list[i].num_misses = misses;
         func_list[i].num_evictions = evictions;
@@ -160,16 +169,339 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
   
 }
 
+/* 
+ * eval_kernels - Evaluate the registered kernels of one kind, each on
+ *     operands A, B and C laid out like the transpose matrices
+ */
+void eval_kernels(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, best = -1;
+    struct cacheConfig config = {0};
+    struct cacheStats stats;
+    size_t sizes[3];
+
+    registerKernels();
+
+    kernelSizes(kind, M, N, K, sizes);
+    traceAddRegion(A, sizes[0] * sizeof(int));
+    traceAddRegion(B, sizes[1] * sizeof(int));
+    traceAddRegion(C, sizes[2] * sizeof(int));
+
+    for (i = 0; i < kernel_counter; i++) {
+        if (kernel_list[i].kind != kind)
+            continue;
+
+        printf("\nFunction %d (%s)\nStep 1: Validating and simulating memory accesses\n",
+               i, kernel_list[i].description);
+        config.s = s;
+        config.E = E;
+        config.b = b;
+        sim = cacheSimCreate(&config);
+        assert(sim);
+        initKernel(kind, M, N, K, &A[0][0], &B[0][0], &C[0][0]);
+        traceStart(simulate_access);
+        runKernel(&kernel_list[i], M, N, K, &A[0][0], &B[0][0], &C[0][0]);
+        traceStop();
+
+        if (!checkKernel(kind, M, N, K, &A[0][0], &B[0][0], &C[0][0])) {
+            printf("Validation error at function %d!\nSkipping performance evaluation for this function.\n", i);
+            cacheSimFree(sim);
+            continue;
+        }
+        kernel_list[i].correct = 1;
+
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+        cacheSimStats(sim, &stats);
+        cacheSimFree(sim);
+        kernel_list[i].num_hits = stats.hits;
+        kernel_list[i].num_misses = stats.misses;
+        kernel_list[i].num_evictions = stats.evictions;
+        printf("func %u (%s): hits:%llu, misses:%llu, evictions:%llu\n",
+               i, kernel_list[i].description, stats.hits, stats.misses, stats.evictions);
+        if (best < 0 || stats.misses < kernel_list[best].num_misses)
+            best = i;
+    }
+
+    if (best < 0)
+        printf("\nError: No correct %s kernel is registered\n", kernelName(kind));
+    else
+        printf("\nSummary for %s kernels: best func %d (%s) misses=%u\n", kernelName(kind),
+               best, kernel_list[best].description, kernel_list[best].num_misses);
+}
+
+/* 
+ * eval_inplace_perf - Simulate the in-place kernels that apply to M x N
+ */
+void eval_inplace_perf(unsigned int s, unsigned int E, unsigned int b)
+{
+    int k;
+    struct cacheConfig config = {0};
+    struct cacheStats stats;
+
+    traceAddRegion(A, N * M * sizeof(int));
+
+    for (k = 0; inplace_kernels_traced[k].func_ptr; k++) {
+        if (inplace_kernels_traced[k].square_only && M != N)
+            continue;
+
+        /* B holds the expected result, A is transposed onto itself */
+        initMatrix(M, N, (int (*)[M])A, (int (*)[N])B);
+        correctTrans(M, N, (int (*)[M])A, (int (*)[N])B);
+
+        config.s = s;
+        config.E = E;
+        config.b = b;
+        /* The SSE2 tile swaps cross blocks, charge them for every block */
+        config.splitStraddles = 1;
+        sim = cacheSimCreate(&config);
+        assert(sim);
+        traceStart(simulate_access);
+        (*inplace_kernels_traced[k].func_ptr)(M, N, &A[0][0]);
+        traceStop();
+        cacheSimStats(sim, &stats);
+        cacheSimFree(sim);
+
+        if (memcmp(A, B, sizeof(int) * M * N)) {
+            printf("Validation error at in-place kernel %d (%s)!\n", k,
+                   inplace_kernels_traced[k].description);
+            continue;
+        }
+        printf("func %d (%s): hits:%llu, misses:%llu, evictions:%llu, straddles:%llu\n",
+               k, inplace_kernels_traced[k].description, stats.hits, stats.misses, stats.evictions,
+               stats.straddles);
+    }
+}
+
+/*
+ * now - Monotonic wall-clock time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * time_kernel - Seconds per call of func on a and b, repeating it until
+ *     it has run for a quarter of a second
+ */
+static double time_kernel(void (*func)(int M, int N, int A[N][M], int B[M][N]),
+                          int (*a)[M], int (*b)[N])
+{
+    int i, reps;
+    double start, elapsed;
+
+    for (reps = 1; ; reps *= 2) {
+        start = now();
+        for (i = 0; i < reps; i++)
+            (*func)(M, N, a, b);
+        elapsed = now() - start;
+        if (elapsed >= 0.25)
+            return elapsed / reps;
+    }
+}
+
+/*
+ * eval_scaling - Time trans_par() with 1, 2, 4, ... up to threads workers,
+ *     each on matrices freshly allocated and first touched by that pool
+ */
+void eval_scaling(void)
+{
+    int t, n;
+    int (*a)[M];
+    int (*b)[N];
+    double seconds, base = 0;
+    double bytes = 2.0 * M * N * sizeof(int);
+
+    printf("\nParallel tiled transpose scaling\n");
+    for (t = 1; t <= threads; t = (t == threads || 2 * t < threads) ? 2 * t : threads) {
+        if (trans_pool_start(t)) {
+            printf("Error: Cannot start %d threads\n", t);
+            return;
+        }
+        a = malloc(sizeof(int) * M * N);
+        b = malloc(sizeof(int) * M * N);
+        if (!a || !b) {
+            printf("Error: Cannot allocate two %d x %d matrices\n", N, M);
+            exit(1);
+        }
+        trans_par_init(M, N, a, b);
+        trans_par(M, N, a, b);
+        n = validate(t, M, N, a, b);
+        seconds = time_kernel(trans_par, a, b);
+        free(a);
+        free(b);
+        trans_pool_stop();
+        if (!n) {
+            printf("Validation error with %d threads!\n", t);
+            continue;
+        }
+
+        if (t == 1)
+            base = seconds;
+        printf("%3d thread%s %10.3f ms %8.2f GB/s %6.2fx\n", t, t == 1 ? " " : "s",
+               seconds * 1e3, bytes / seconds / 1e9, base > 0 ? base / seconds : 0);
+    }
+}
+
+/*
+ * eval_wallclock - Time every kernel of trans-simd.c on a heap-allocated
+ *     N x M matrix, repeating each until it has run for a quarter of a
+ *     second, and report its throughput and its speedup over the scalar
+ *     blocked kernel
+ */
+void eval_wallclock(void)
+{
+    int i, j, k;
+    int (*a)[M];
+    int (*b)[N];
+    double base;
+    double seconds[16];
+    double bytes = 2.0 * M * N * sizeof(int);
+
+    a = malloc(sizeof(int) * M * N);
+    b = malloc(sizeof(int) * M * N);
+    if (!a || !b) {
+        printf("Error: Cannot allocate two %d x %d matrices\n", N, M);
+        exit(1);
+    }
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            a[i][j] = (int)((long)i * M + j);
+
+    printf("Wall-clock throughput on a %d x %d matrix (%.1f MB moved per transpose)\n",
+           N, M, bytes / 1e6);
+
+    for (k = 0; trans_kernels[k].func_ptr; k++) {
+        seconds[k] = 0;
+        if (trans_kernels[k].available && !trans_kernels[k].available())
+            continue;
+
+        /* The first run faults B in and is checked, but not timed */
+        memset(b, 0, sizeof(int) * M * N);
+        (*trans_kernels[k].func_ptr)(M, N, a, b);
+        if (!validate(k, M, N, a, b)) {
+            printf("Validation error at kernel %d (%s)!\n", k, trans_kernels[k].description);
+            continue;
+        }
+
+        seconds[k] = time_kernel(trans_kernels[k].func_ptr, a, b);
+    }
+
+    /* Speedups are relative to the scalar 8 x 8 blocked kernel */
+    base = 0;
+    for (k = 0; trans_kernels[k].func_ptr; k++)
+        if (trans_kernels[k].func_ptr == trans_scalar_blocked)
+            base = seconds[k];
+
+    for (k = 0; trans_kernels[k].func_ptr; k++) {
+        if (seconds[k] == 0) {
+            printf("%-32s skipped\n", trans_kernels[k].description);
+            continue;
+        }
+        printf("%-32s %10.3f ms %8.2f GB/s", trans_kernels[k].description,
+               seconds[k] * 1e3, bytes / seconds[k] / 1e9);
+        if (base > 0)
+            printf(" %6.2fx", base / seconds[k]);
+        printf("\n");
+    }
+
+    free(a);
+    free(b);
+
+    if (threads > 0)
+        eval_scaling();
+}
+
+/*
+ * eval_inplace_wallclock - Time the in-place kernels on a heap-allocated
+ *     N x M matrix next to the out-of-place SIMD kernel. Every call
+ *     transposes the result of the one before, so the shape alternates.
+ */
+void eval_inplace_wallclock(void)
+{
+    int k, reps;
+    long i;
+    int *a, *b, *expect;
+    double start, elapsed;
+    double bytes = 2.0 * M * N * sizeof(int);
+    size_t size = sizeof(int) * M * N;
+    void (*func)(int M, int N, int *A);
+
+    a = malloc(size);
+    expect = malloc(size);
+    if (!a || !expect) {
+        printf("Error: Cannot allocate two %d x %d matrices\n", N, M);
+        exit(1);
+    }
+    for (i = 0; i < (long)M * N; i++)
+        a[i] = (int)i;
+    trans_simd(M, N, (int (*)[M])a, (int (*)[N])expect);
+
+    printf("In-place wall-clock throughput on a %d x %d matrix\n", N, M);
+
+    /* The out-of-place kernel, for reference, needs a second matrix */
+    b = malloc(size);
+    if (b) {
+        trans_simd(M, N, (int (*)[M])a, (int (*)[N])b);
+        elapsed = time_kernel(trans_simd, (int (*)[M])a, (int (*)[N])b);
+        printf("%-32s %10.3f ms %8.2f GB/s  +%.1f MB\n", "Out-of-place SIMD",
+               elapsed * 1e3, bytes / elapsed / 1e9, size / 1e6);
+        free(b);
+    }
+
+    for (k = 0; inplace_kernels[k].func_ptr; k++) {
+        if (inplace_kernels[k].square_only && M != N)
+            continue;
+        func = inplace_kernels[k].func_ptr;
+
+        (*func)(M, N, a);
+        if (memcmp(a, expect, size)) {
+            printf("Validation error at in-place kernel %d (%s)!\n", k,
+                   inplace_kernels[k].description);
+            exit(1);
+        }
+        (*func)(N, M, a);
+
+        for (reps = 2; ; reps *= 2) {
+            start = now();
+            for (i = 0; i < reps; i += 2) {
+                (*func)(M, N, a);
+                (*func)(N, M, a);
+            }
+            elapsed = now() - start;
+            if (elapsed >= 0.25)
+                break;
+        }
+        elapsed /= reps;
+        printf("%-32s %10.3f ms %8.2f GB/s  +%.1f MB\n", inplace_kernels[k].description,
+               elapsed * 1e3, bytes / elapsed / 1e9,
+               func == trans_inplace_cycles ? ((double)M * N / 8 + 1) / 1e6 : 0.0);
+    }
+
+    free(a);
+    free(expect);
+}
+
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hwi] [-j <threads>] [-k <kind>] [-K <k>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+    printf("  -w          Time the SIMD kernels instead, any matrix size\n");
+    printf("  -j <n>      With -w, also time the parallel transpose on 1 to n threads\n");
+    printf("  -i          Evaluate the in-place kernels instead (with -w, time them)\n");
+    printf("  -k <kind>   Evaluate the kernels.c kernels of kind mm, stencil or conv\n");
+    printf("  -K <k>      Inner dimension for mm (default M), filter width for conv (default 3)\n");
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
+    printf("         %s -w -j 8 -M 16384 -N 16384\n", argv[0]);
+    printf("         %s -k mm -M 64 -N 64 -K 64\n", argv[0]);
 }
 
 /*
@@ -199,7 +531,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:hwij:k:K:")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +539,26 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'w':
+            wallclock = 1;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'i':
+            inplace = 1;
+            break;
+        case 'k':
+            kind = kernelKind(optarg);
+            if (kind < 0 && strcmp(optarg, "trans") != 0) {
+                printf("Error: Unknown kernel kind %s\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'K':
+            K = atoi(optarg);
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -222,6 +574,15 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    /* Timing uses its own heap matrices, so it is not bounded by MAXN */
+    if (wallclock) {
+        if (inplace)
+            eval_inplace_wallclock();
+        else
+            eval_wallclock();
+        return 0;
+    }
+
     if (M > MAXN || N > MAXN) {
         printf("Error: M or N exceeds %d\n", MAXN);
         usage(argv);
@@ -243,6 +604,21 @@ int main(int argc, char* argv[])
     alarm(120);
 
     /* Check the performance of the student's transpose function */
+    if (inplace) {
+        eval_inplace_perf(5, 1, 5);
+        return 0;
+    }
+
+    if (kind >= 0) {
+        if (K == 0)
+            K = kind == KERNEL_MM ? M : 3;
+        if (K < 1 || K > MAXN || (kind == KERNEL_CONV && (K > M || K > N))) {
+            printf("Error: K=%d does not fit a %d x %d %s\n", K, N, M, kernelName(kind));
+            exit(1);
+        }
+        eval_kernels(5, 1, 5);
+        return 0;
+    }
     eval_perf(5, 1, 5);
   
     /* Emit the results for this particular test */
@@ -0,0 +1,201 @@
+/* 
+ * tracefile.c - Text and delta/varint binary lackey traces
+ *
+ * Binary traces are read and written through a buffer of their own, a
+ * byte at a time, so decoding streams through traces of any length.
+ * Text traces are read with the same fscanf pattern csim always used,
+ * which keeps its handling of their leading blanks unchanged.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tracefile.h"
+
+#define BUFFER_SIZE (1 << 16)
+
+/* Tag byte layout */
+#define TAG_OP_MASK   0x03
+#define TAG_SIZE_SHIFT 2
+#define TAG_SIZE_MASK 0x07
+#define TAG_SIZE_VARINT 7
+#define TAG_RESERVED  0xe0
+
+static const char ops[] = "ILSM";
+
+struct traceFile {
+    FILE *fp;
+    int binary, writing, error;
+    unsigned long long last[2];     /* previous instruction and data addresses */
+    unsigned char buffer[BUFFER_SIZE];
+    int pos, len;
+};
+
+/* 
+ * readByte - Next byte of a binary trace, -1 at the end
+ */
+static int readByte(struct traceFile *tf) {
+    if (tf->pos == tf->len) {
+        tf->len = fread(tf->buffer, 1, BUFFER_SIZE, tf->fp);
+        tf->pos = 0;
+        if (tf->len <= 0)
+            return -1;
+    }
+    return tf->buffer[tf->pos++];
+}
+
+/* 
+ * readVarint - Decode a varint, returns 0 and flags an error if the
+ *     trace ends inside it or it overflows
+ */
+static int readVarint(struct traceFile *tf, unsigned long long *value) {
+    unsigned long long v = 0;
+    int shift = 0, c;
+
+    do {
+        c = readByte(tf);
+        if (c < 0 || shift > 63) {
+            tf->error = 1;
+            return 0;
+        }
+        v |= (unsigned long long)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *value = v;
+    return 1;
+}
+
+static void writeByte(struct traceFile *tf, int c) {
+    if (tf->pos == BUFFER_SIZE) {
+        if (fwrite(tf->buffer, 1, BUFFER_SIZE, tf->fp) != BUFFER_SIZE)
+            tf->error = 1;
+        tf->pos = 0;
+    }
+    tf->buffer[tf->pos++] = c;
+}
+
+static void writeVarint(struct traceFile *tf, unsigned long long value) {
+    while (value >= 0x80) {
+        writeByte(tf, (value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    writeByte(tf, value);
+}
+
+struct traceFile *traceFileOpen(const char *filename) {
+    struct traceFile *tf = calloc(1, sizeof(struct traceFile));
+    char magic[sizeof(TRACE_MAGIC) - 1];
+
+    if (tf == NULL)
+        return NULL;
+    tf->fp = fopen(filename, "rb");
+    if (tf->fp == NULL) {
+        free(tf);
+        return NULL;
+    }
+    if (fread(magic, 1, sizeof(magic), tf->fp) == sizeof(magic) 
+        && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+        tf->binary = 1;
+    else
+        rewind(tf->fp);
+    return tf;
+}
+
+struct traceFile *traceFileCreate(const char *filename, int text) {
+    struct traceFile *tf = calloc(1, sizeof(struct traceFile));
+
+    if (tf == NULL)
+        return NULL;
+    tf->fp = fopen(filename, text ? "w" : "wb");
+    if (tf->fp == NULL) {
+        free(tf);
+        return NULL;
+    }
+    tf->writing = 1;
+    tf->binary = !text;
+    if (tf->binary && fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC) - 1, tf->fp) != sizeof(TRACE_MAGIC) - 1)
+        tf->error = 1;
+    return tf;
+}
+
+int traceFileRead(struct traceFile *tf, struct cacheAccess *access) {
+    unsigned long long delta, size;
+    unsigned long long *last;
+    int tag, code;
+
+    if (!tf->binary) {
+        access->op = 0;
+        access->addr = 0;
+        access->size = 0;
+        return fscanf(tf->fp, "%c %llx, %d\n", &access->op, &access->addr, &access->size) > 0;
+    }
+
+    tag = readByte(tf);
+    if (tag < 0)
+        return 0;
+    if (tag & TAG_RESERVED) {
+        tf->error = 1;
+        return 0;
+    }
+    code = (tag >> TAG_SIZE_SHIFT) & TAG_SIZE_MASK;
+    if (code == TAG_SIZE_VARINT) {
+        if (!readVarint(tf, &size))
+            return 0;
+    } else {
+        size = 1ULL << code;
+    }
+    if (!readVarint(tf, &delta))
+        return 0;
+
+    // undo the zigzag mapping, small negative deltas became small odd numbers
+    access->op = ops[tag & TAG_OP_MASK];
+    last = &tf->last[access->op != 'I'];
+    *last += (delta >> 1) ^ (0 - (delta & 1));
+    access->addr = *last;
+    access->size = (int)size;
+    return 1;
+}
+
+int traceFileWrite(struct traceFile *tf, const struct cacheAccess *access) {
+    const char *op = access->op ? strchr(ops, access->op) : NULL;
+    unsigned long long *last, delta;
+    int code;
+
+    if (op == NULL)
+        return -1;
+    if (!tf->binary) {
+        if (access->op == 'I')
+            fprintf(tf->fp, "I  %08llx,%d\n", access->addr, access->size);
+        else
+            fprintf(tf->fp, " %c %08llx,%d\n", access->op, access->addr, access->size);
+        return 0;
+    }
+
+    for (code = 0; code < TAG_SIZE_VARINT && access->size != 1 << code; ++code)
+        ;
+    writeByte(tf, (int)(op - ops) | code << TAG_SIZE_SHIFT);
+    if (code == TAG_SIZE_VARINT)
+        writeVarint(tf, (unsigned int)access->size);
+
+    last = &tf->last[access->op != 'I'];
+    delta = access->addr - *last;
+    writeVarint(tf, (delta << 1) ^ (0 - (delta >> 63)));
+    *last = access->addr;
+    return 0;
+}
+
+int traceFileIsBinary(const struct traceFile *tf) {
+    return tf->binary;
+}
+
+int traceFileClose(struct traceFile *tf) {
+    int error = tf->error;
+
+    if (tf->writing && tf->binary && tf->pos > 0 
+        && fwrite(tf->buffer, 1, tf->pos, tf->fp) != (size_t)tf->pos)
+        error = 1;
+    if (fclose(tf->fp) != 0)
+        error = 1;
+    free(tf);
+    return error ? -1 : 0;
+}
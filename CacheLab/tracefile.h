@@ -0,0 +1,42 @@
+/* 
+ * tracefile.h - Reading and writing lackey traces, either as valgrind's
+ *     text or in a compact binary form that decodes without parsing.
+ *
+ * A binary trace starts with the 8 bytes of TRACE_MAGIC, followed by one
+ * record per access: a tag byte holding the operation (bits 0-1: I, L,
+ * S, M) and the size (bits 2-4: size 1 << code, or 7 when the size
+ * follows as a varint), then the zigzag varint difference between the
+ * address and the previous address of the same stream. Instructions and
+ * data are separate streams, so sequential code and strided data both
+ * encode in a byte or two. Varints are little-endian base-128 (LEB128).
+ */
+
+#ifndef CACHELAB_TRACEFILE_H
+#define CACHELAB_TRACEFILE_H
+
+#include "cachesim.h"
+
+#define TRACE_MAGIC "CSTRACE1"
+
+struct traceFile;
+
+/* Open a trace for reading, binary if it starts with TRACE_MAGIC, else text */
+struct traceFile *traceFileOpen(const char *filename);
+
+/* Create a trace for writing, binary unless text is set */
+struct traceFile *traceFileCreate(const char *filename, int text);
+
+/* Read the next record, 1 if there was one and 0 at the end of the trace
+   or at a corrupt record, which makes traceFileClose() fail */
+int traceFileRead(struct traceFile *tf, struct cacheAccess *access);
+
+/* Append a record, -1 if its operation has no encoding */
+int traceFileWrite(struct traceFile *tf, const struct cacheAccess *access);
+
+/* Whether the trace is in the binary form */
+int traceFileIsBinary(const struct traceFile *tf);
+
+/* Flush a written trace and close it, -1 if anything failed or was corrupt */
+int traceFileClose(struct traceFile *tf);
+
+#endif /* CACHELAB_TRACEFILE_H */
@@ -4,7 +4,14 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, along with the
+ * address ranges of the A and B matrices.
+ *
+ * The transpose functions are linked in instrumented (see tracehook.c),
+ * so tracegen can also write their traces itself (-t) or simulate them
+ * in-process (-s, -E, -b) without valgrind. With -k it does the same
+ * for the kernels.c kernels of one kind, whose output matrix C is
+ * recorded as a third region.
  */
 
 #include <stdlib.h>
@@ -13,6 +20,8 @@
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "tracehook.h"
+#include "cachesim.h"
 #include <string.h>
 
 /* External variables declared in cachelab.c */
@@ -22,23 +31,129 @@ extern int func_counter;
 /* External function from trans.c */
 extern void registerFunctions();
 
+/* External variables and function for the other kernel kinds */
+extern kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+extern int kernel_counter;
+extern void registerKernels();
+
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
-static int A[256][256];
-static int B[256][256];
+/* 
+ * Matrices up to 256 x 256 keep the static layout the graded miss counts
+ * were measured on, larger ones are allocated once M and N are known.
+ */
+#define MAXN 256
+static int static_A[MAXN][MAXN];
+static int static_B[MAXN][MAXN];
+static int *A = &static_A[0][0];
+static int *B = &static_B[0][0];
+static int C[MAXN * MAXN];
 static int M;
 static int N;
+static int K;
+
+/* Destinations of the in-process trace, when requested */
+static FILE* trace_fp = NULL;
+static struct cacheSim* sim = NULL;
+
+/* trace_access - Trace sink, writes and/or simulates one access */
+void trace_access(char op, unsigned long long addr, int size) {
+    if (trace_fp)
+        fprintf(trace_fp, " %c %llx,%d\n", op, addr, size);
+    if (sim)
+        cacheSimAccess(sim, op, addr, size);
+}
+
+/* run - Invoke one transpose function between the markers */
+void run(int fn, struct cacheConfig *config) {
+    struct cacheStats stats;
 
+    if (config->s || config->E || config->b) {
+        sim = cacheSimCreate(config);
+        assert(sim);
+    }
+    traceStart(trace_access);
+    MARKER_START = 33;
+    (*func_list[fn].func_ptr)(M, N, (int (*)[M])A, (int (*)[N])B);
+    MARKER_END = 34;
+    traceStop();
+    if (sim) {
+        cacheSimStats(sim, &stats);
+        printf("func %d (%s): hits:%llu, misses:%llu, evictions:%llu\n",
+               fn, func_list[fn].description, stats.hits, stats.misses, stats.evictions);
+        cacheSimFree(sim);
+        sim = NULL;
+    }
+}
+
+/* run_kernel - Invoke one kernel of another kind between the markers */
+void run_kernel(int fn, struct cacheConfig *config) {
+    struct cacheStats stats;
+
+    if (config->s || config->E || config->b) {
+        sim = cacheSimCreate(config);
+        assert(sim);
+    }
+    traceStart(trace_access);
+    MARKER_START = 33;
+    runKernel(&kernel_list[fn], M, N, K, A, B, C);
+    MARKER_END = 34;
+    traceStop();
+    if (sim) {
+        cacheSimStats(sim, &stats);
+        printf("func %d (%s): hits:%llu, misses:%llu, evictions:%llu\n",
+               fn, kernel_list[fn].description, stats.hits, stats.misses, stats.evictions);
+        cacheSimFree(sim);
+        sim = NULL;
+    }
+}
+
+/* 
+ * trace_kernels - Run, trace and check the selected kernel, or every
+ *     kernel of the given kind, on the static matrices
+ */
+int trace_kernels(int kind, int selectedFunc, struct cacheConfig *config) {
+    size_t sizes[3];
+    int i;
+
+    registerKernels();
+    if (K == 0)
+        K = kind == KERNEL_MM ? M : 3;
+    if (M > MAXN || N > MAXN || K < 1 || K > MAXN || (kind == KERNEL_CONV && (K > M || K > N))) {
+        printf("./tracegen cannot run %s kernels on %d x %d with K=%d.\n", kernelName(kind), N, M, K);
+        exit(1);
+    }
+    kernelSizes(kind, M, N, K, sizes);
+
+    FILE* region_fp = fopen(".regions","w");
+    assert(region_fp);
+    fprintf(region_fp, "A %llx %d\nB %llx %d\nC %llx %d\n",
+            (unsigned long long int) A, (int) (sizes[0] * sizeof(int)),
+            (unsigned long long int) B, (int) (sizes[1] * sizeof(int)),
+            (unsigned long long int) C, (int) (sizes[2] * sizeof(int)));
+    fclose(region_fp);
+
+    traceAddRegion(A, sizes[0] * sizeof(int));
+    traceAddRegion(B, sizes[1] * sizeof(int));
+    traceAddRegion(C, sizes[2] * sizeof(int));
+
+    for (i = 0; i < kernel_counter; i++) {
+        if (selectedFunc == -1 ? kernel_list[i].kind != kind : i != selectedFunc)
+            continue;
+        initKernel(kernel_list[i].kind, M, N, K, A, B, C);
+        run_kernel(i, config);
+        if (!checkKernel(kernel_list[i].kind, M, N, K, A, B, C))
+            return i+1;
+    }
+    return 0;
+}
 
 int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
     for(int i=0;i<M;i++) {
         for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+            if(B[i][j]!=A[j][i]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,A[j][i],B[i][j],i,j);
                 return 0;
             }
         }
@@ -51,7 +166,9 @@ int main(int argc, char* argv[]){
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int kind=-1;
+    struct cacheConfig config = {0};
+    while( (c=getopt(argc,argv,"M:N:F:s:E:b:t:k:K:")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +179,29 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 's':
+            config.s = atoi(optarg);
+            break;
+        case 'E':
+            config.E = atoi(optarg);
+            break;
+        case 'b':
+            config.b = atoi(optarg);
+            break;
+        case 't':
+            trace_fp = fopen(optarg, "w");
+            assert(trace_fp);
+            break;
+        case 'k':
+            kind = kernelKind(optarg);
+            if (kind < 0) {
+                printf("./tracegen knows no kernel kind %s.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'K':
+            K = atoi(optarg);
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -70,12 +210,6 @@ int main(int argc, char* argv[]){
     }
   
 
-    /*  Register transpose functions */
-    registerFunctions();
-
-    /* Fill A with data */
-    initMatrix(M,N, A, B); 
-
     /* Record marker addresses */
     FILE* marker_fp = fopen(".marker","w");
     assert(marker_fp);
@@ -84,23 +218,52 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
+    if (kind >= 0) {
+        i = trace_kernels(kind, selectedFunc, &config);
+        if (trace_fp)
+            fclose(trace_fp);
+        return i;
+    }
+
+    /*  Register transpose functions */
+    registerFunctions();
+
+    if (M > MAXN || N > MAXN) {
+        A = malloc(sizeof(int) * M * N);
+        B = malloc(sizeof(int) * M * N);
+        assert(A && B);
+    }
+
+    /* Fill A with data */
+    initMatrix(M,N, (int (*)[M])A, (int (*)[N])B); 
+
+    /* Record where the matrices live, for csim -r miss attribution */
+    FILE* region_fp = fopen(".regions","w");
+    assert(region_fp);
+    fprintf(region_fp, "A %llx %d\nB %llx %d\n",
+            (unsigned long long int) A, (int) (N * M * sizeof(int)),
+            (unsigned long long int) B, (int) (M * N * sizeof(int)));
+    fclose(region_fp);
+
+    /* Only accesses to the matrices are traced */
+    traceAddRegion(A, N * M * sizeof(int));
+    traceAddRegion(B, M * N * sizeof(int));
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            run(i, &config);
+            if (!validate(i,M,N,(int (*)[M])A,(int (*)[N])B))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        run(selectedFunc, &config);
+        if (!validate(selectedFunc,M,N,(int (*)[M])A,(int (*)[N])B))
             return selectedFunc+1;
 
     }
+    if (trace_fp)
+        fclose(trace_fp);
     return 0;
 }
 
@@ -0,0 +1,95 @@
+/*
+ * tracehook.c - Load/store hooks for code instrumented with
+ *     -fsanitize=thread, forwarding accesses to matrices of interest
+ *     to a trace sink. This file itself must not be instrumented.
+ */
+#include <stdio.h>
+#include "tracehook.h"
+
+struct traceRegion {
+    unsigned long long base, size;
+};
+
+static struct traceRegion regions[MAX_TRACE_REGIONS];
+static int numRegions = 0;
+static trace_sink_t activeSink = NULL;
+
+/* 
+ * traceAddRegion - Register a range of addresses to be traced 
+ */
+void traceAddRegion(const void *base, size_t size)
+{
+    if (numRegions == MAX_TRACE_REGIONS) {
+        fprintf(stderr, "traceAddRegion: too many regions\n");
+        return;
+    }
+    regions[numRegions].base = (unsigned long long) base;
+    regions[numRegions].size = size;
+    numRegions++;
+}
+
+void traceClearRegions(void)
+{
+    numRegions = 0;
+}
+
+void traceStart(trace_sink_t sink)
+{
+    activeSink = sink;
+}
+
+void traceStop(void)
+{
+    activeSink = NULL;
+}
+
+/* 
+ * traceAccess - Forward an access to the sink if tracing is on and the
+ *     address lies in a registered region 
+ */
+static void traceAccess(char op, const void *addr, int size)
+{
+    unsigned long long a = (unsigned long long) addr;
+    int i;
+
+    if (activeSink == NULL)
+        return;
+    for (i = 0; i < numRegions; i++) {
+        if (a - regions[i].base < regions[i].size) {
+            activeSink(op, a, size);
+            return;
+        }
+    }
+}
+
+/*
+ * The hooks below are the entry points the compiler emits calls to.
+ * Function entry/exit and initialization need no work.
+ */
+void __tsan_init(void) {}
+void __tsan_func_entry(void *call_pc) {}
+void __tsan_func_exit(void) {}
+
+#define TRACE_HOOKS(n) \
+    void __tsan_read##n(void *addr) { traceAccess('L', addr, n); } \
+    void __tsan_write##n(void *addr) { traceAccess('S', addr, n); } \
+    void __tsan_unaligned_read##n(void *addr) { traceAccess('L', addr, n); } \
+    void __tsan_unaligned_write##n(void *addr) { traceAccess('S', addr, n); } \
+    void __tsan_volatile_read##n(void *addr) { traceAccess('L', addr, n); } \
+    void __tsan_volatile_write##n(void *addr) { traceAccess('S', addr, n); }
+
+TRACE_HOOKS(1)
+TRACE_HOOKS(2)
+TRACE_HOOKS(4)
+TRACE_HOOKS(8)
+TRACE_HOOKS(16)
+
+void __tsan_read_range(void *addr, unsigned long size) 
+{ 
+    traceAccess('L', addr, (int) size); 
+}
+
+void __tsan_write_range(void *addr, unsigned long size) 
+{ 
+    traceAccess('S', addr, (int) size); 
+}
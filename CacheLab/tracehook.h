@@ -0,0 +1,32 @@
+/* 
+ * tracehook.h - In-process memory tracing for Cache Lab
+ *
+ * Code compiled with -fsanitize=thread calls a __tsan_* hook before
+ * every load and store it makes to memory that is not a private local.
+ * tracehook.c supplies those hooks itself (libtsan is never linked), so
+ * a transpose function can be traced by simply calling it, without
+ * running it under valgrind.
+ */
+
+#ifndef CACHELAB_TRACEHOOK_H
+#define CACHELAB_TRACEHOOK_H
+
+#include <stddef.h>
+
+#define MAX_TRACE_REGIONS 8
+
+/* Receives one traced access: op is 'L' or 'S', size is in bytes */
+typedef void (*trace_sink_t)(char op, unsigned long long addr, int size);
+
+/* Only accesses that fall inside a registered region are traced */
+void traceAddRegion(const void *base, size_t size);
+
+/* Forget every registered region */
+void traceClearRegions(void);
+
+/* Send the accesses of instrumented code to sink until traceStop() */
+void traceStart(trace_sink_t sink);
+
+void traceStop(void);
+
+#endif /* CACHELAB_TRACEHOOK_H */
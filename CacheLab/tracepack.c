@@ -0,0 +1,96 @@
+/*
+ * tracepack.c - Converts lackey traces between valgrind's text form and
+ *     the compact binary form of tracefile.h, which csim reads directly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include "tracefile.h"
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[])
+{
+    printf("Usage: %s [-hd] <in> <out>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -d          Write text instead of binary (the input may be either).\n");
+    printf("Examples: %s traces/long.trace long.bin\n", argv[0]);
+    printf("          %s -d long.bin long.trace\n", argv[0]);
+}
+
+/*
+ * file_size - Size of a file in bytes, 0 if it cannot be read
+ */
+static long long file_size(const char *filename)
+{
+    struct stat st;
+
+    return stat(filename, &st) == 0 ? (long long) st.st_size : 0;
+}
+
+/*
+ * main - Copy every record of the input trace to the output trace
+ */
+int main(int argc, char *argv[])
+{
+    struct traceFile *in, *out;
+    struct cacheAccess access;
+    long long records = 0, skipped = 0, before, after;
+    int text = 0;
+    char c;
+
+    while ((c = getopt(argc, argv, "dh")) != -1) {
+        switch (c) {
+        case 'd':
+            text = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    in = traceFileOpen(argv[optind]);
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s\n", argv[optind]);
+        exit(1);
+    }
+    out = traceFileCreate(argv[optind + 1], text);
+    if (out == NULL) {
+        fprintf(stderr, "Cannot create %s\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    // text traces yield a record for the blank that starts them, drop it
+    while (traceFileRead(in, &access)) {
+        if (traceFileWrite(out, &access) < 0)
+            skipped++;
+        else
+            records++;
+    }
+    if (traceFileClose(in) < 0) {
+        fprintf(stderr, "%s is corrupt after %lld records\n", argv[optind], records);
+        exit(1);
+    }
+    if (traceFileClose(out) < 0) {
+        fprintf(stderr, "Cannot write %s\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    before = file_size(argv[optind]);
+    after = file_size(argv[optind + 1]);
+    printf("%lld records (%lld unencodable skipped): %lld -> %lld bytes (%.1fx)\n",
+           records, skipped, before, after, after ? (double) before / after : 0.0);
+    return 0;
+}
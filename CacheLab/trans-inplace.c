@@ -0,0 +1,171 @@
+/* 
+ * trans-inplace.c - In-place square and rectangular transposes
+ *
+ * A square matrix is its own transpose's shape, so tiles above the
+ * diagonal just trade places with their mirror images below it, and
+ * diagonal tiles are transposed within themselves. Tiles move in 4 x 4
+ * quarters held in SSE2 registers, which every x86-64 has.
+ *
+ * A rectangular one is a permutation of its M * N elements: the element
+ * at offset p of the N x M matrix belongs at offset p * N mod (M * N - 1)
+ * of the M x N one (the first and last elements stay put). Each cycle
+ * of that permutation is rotated by one, pulling every element from the
+ * offset p * M mod (M * N - 1) that it comes from. A bitmap, one bit per
+ * element, marks the offsets already placed so each cycle is rotated
+ * only once.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "trans-inplace.h"
+
+/* The instrumented build gets its own names, see trans-inplace.h */
+#ifdef TRACED
+#define trans_inplace_naive trans_inplace_naive_traced
+#define trans_inplace_square trans_inplace_square_traced
+#define trans_inplace_cycles trans_inplace_cycles_traced
+#define trans_inplace trans_inplace_traced
+#define inplace_kernels inplace_kernels_traced
+#endif
+
+#define TILESIZE 8
+
+void trans_inplace_naive(int M, int N, int *A) {
+    int i, j, tmp;
+    int (*a)[M] = (int (*)[M])A;
+
+    for (i = 0; i < N; ++i) {
+        for (j = i + 1; j < M; ++j) {
+            tmp = a[i][j];
+            a[i][j] = a[j][i];
+            a[j][i] = tmp;
+        }
+    }
+}
+
+/* 
+ * swap_quarters - Exchange the 4 x 4 tiles at p and q, each transposed:
+ *     the rows of both are loaded into registers, transposed there and
+ *     stored as rows in the other's place. With p == q the tile is just
+ *     transposed in place.
+ */
+static void swap_quarters(int *p, int *q, int lda) {
+    __m128i p0, p1, p2, p3, q0, q1, q2, q3, t0, t1, t2, t3;
+
+    p0 = _mm_loadu_si128((const __m128i *)(p));
+    p1 = _mm_loadu_si128((const __m128i *)(p + lda));
+    p2 = _mm_loadu_si128((const __m128i *)(p + 2 * lda));
+    p3 = _mm_loadu_si128((const __m128i *)(p + 3 * lda));
+    q0 = _mm_loadu_si128((const __m128i *)(q));
+    q1 = _mm_loadu_si128((const __m128i *)(q + lda));
+    q2 = _mm_loadu_si128((const __m128i *)(q + 2 * lda));
+    q3 = _mm_loadu_si128((const __m128i *)(q + 3 * lda));
+
+    t0 = _mm_unpacklo_epi32(p0, p1);
+    t1 = _mm_unpackhi_epi32(p0, p1);
+    t2 = _mm_unpacklo_epi32(p2, p3);
+    t3 = _mm_unpackhi_epi32(p2, p3);
+    _mm_storeu_si128((__m128i *)(q), _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128((__m128i *)(q + lda), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128((__m128i *)(q + 2 * lda), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128((__m128i *)(q + 3 * lda), _mm_unpackhi_epi64(t1, t3));
+
+    t0 = _mm_unpacklo_epi32(q0, q1);
+    t1 = _mm_unpackhi_epi32(q0, q1);
+    t2 = _mm_unpacklo_epi32(q2, q3);
+    t3 = _mm_unpackhi_epi32(q2, q3);
+    _mm_storeu_si128((__m128i *)(p), _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128((__m128i *)(p + lda), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128((__m128i *)(p + 2 * lda), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128((__m128i *)(p + 3 * lda), _mm_unpackhi_epi64(t1, t3));
+}
+
+/* 
+ * swap_tiles - Exchange the 8 x 8 tiles at (i0, j0) and (j0, i0), each
+ *     transposed, a quarter at a time, so both are only ever read and
+ *     written along their rows
+ */
+static void swap_tiles(int M, int a[][M], int i0, int j0) {
+    swap_quarters(&a[i0][j0], &a[j0][i0], M);
+    swap_quarters(&a[i0][j0 + 4], &a[j0 + 4][i0], M);
+    swap_quarters(&a[i0 + 4][j0], &a[j0][i0 + 4], M);
+    swap_quarters(&a[i0 + 4][j0 + 4], &a[j0 + 4][i0 + 4], M);
+}
+
+/* 
+ * trans_diagonal - Transpose the 8 x 8 tile at (i0, i0) within itself
+ */
+static void trans_diagonal(int M, int a[][M], int i0) {
+    swap_quarters(&a[i0][i0], &a[i0][i0], M);
+    swap_quarters(&a[i0][i0 + 4], &a[i0 + 4][i0], M);
+    swap_quarters(&a[i0 + 4][i0 + 4], &a[i0 + 4][i0 + 4], M);
+}
+
+void trans_inplace_square(int M, int N, int *A) {
+    int i, j, k, tmp;
+    int n = N - N % TILESIZE;
+    int (*a)[M] = (int (*)[M])A;
+
+    for (i = 0; i < n; i += TILESIZE) {
+        trans_diagonal(M, a, i);
+        for (j = i + TILESIZE; j < n; j += TILESIZE)
+            swap_tiles(M, a, i, j);
+    }
+
+    /* The rows and columns past the last whole tile */
+    for (i = n; i < N; ++i) {
+        for (k = 0; k < i; ++k) {
+            tmp = a[i][k];
+            a[i][k] = a[k][i];
+            a[k][i] = tmp;
+        }
+    }
+}
+
+void trans_inplace_cycles(int M, int N, int *A) {
+    long size = (long)M * N - 1;
+    long start, p, src;
+    unsigned char *placed;
+    int tmp;
+
+    if (M == 1 || N == 1)
+        return;
+
+    placed = calloc(size / 8 + 1, 1);
+    if (!placed)
+        abort();
+
+    for (start = 1; start < size; ++start) {
+        if (placed[start >> 3] & (1 << (start & 7)))
+            continue;
+
+        /* Rotate the cycle through start, pulling each element into place */
+        tmp = A[start];
+        p = start;
+        for (;;) {
+            placed[p >> 3] |= 1 << (p & 7);
+            src = p * M % size;
+            if (src == start)
+                break;
+            A[p] = A[src];
+            p = src;
+        }
+        A[p] = tmp;
+    }
+    free(placed);
+}
+
+void trans_inplace(int M, int N, int *A) {
+    if (M == N)
+        trans_inplace_square(M, N, A);
+    else
+        trans_inplace_cycles(M, N, A);
+}
+
+struct inplace_kernel inplace_kernels[] = {
+    {"In-place element swap", trans_inplace_naive, 1},
+    {"In-place 8 x 8 tile swap", trans_inplace_square, 1},
+    {"In-place cycle following", trans_inplace_cycles, 0},
+    {NULL, NULL, 0}
+};
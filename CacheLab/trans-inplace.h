@@ -0,0 +1,40 @@
+/* 
+ * trans-inplace.h - In-place matrix transpose, no second buffer for B
+ *
+ * An in-place kernel takes the N x M matrix in A and leaves its M x N
+ * transpose in the same memory. trans-inplace.c is built twice: plainly
+ * for test-trans -w -i to time, and instrumented (-DTRACED, every name
+ * suffixed with _traced) for test-trans -i to count its misses.
+ */
+
+#ifndef CACHELAB_TRANS_INPLACE_H
+#define CACHELAB_TRANS_INPLACE_H
+
+/* An in-place kernel that test-trans -i can evaluate */
+struct inplace_kernel {
+    const char *description;
+    void (*func_ptr)(int M, int N, int *A);
+    int square_only;            /* only defined for M == N */
+};
+
+/* NULL-terminated */
+extern struct inplace_kernel inplace_kernels[];
+extern struct inplace_kernel inplace_kernels_traced[];
+
+/* Swap A[i][j] and A[j][i] element by element, M == N */
+void trans_inplace_naive(int M, int N, int *A);
+void trans_inplace_naive_traced(int M, int N, int *A);
+
+/* Swap 8 x 8 tiles across the diagonal, M == N */
+void trans_inplace_square(int M, int N, int *A);
+void trans_inplace_square_traced(int M, int N, int *A);
+
+/* Follow the cycles of the permutation, any M and N */
+void trans_inplace_cycles(int M, int N, int *A);
+void trans_inplace_cycles_traced(int M, int N, int *A);
+
+/* Picks the square or the cycle-following kernel */
+void trans_inplace(int M, int N, int *A);
+void trans_inplace_traced(int M, int N, int *A);
+
+#endif /* CACHELAB_TRANS_INPLACE_H */
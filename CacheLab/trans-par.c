@@ -0,0 +1,191 @@
+/* 
+ * trans-par.c - Multithreaded tiled transpose on a persistent thread pool
+ *
+ * Worker t owns rows [t * M / T, (t + 1) * M / T) of B, rounded to the
+ * 8-int tile width, and reads the same columns of A. The writes, which
+ * cost more than the reads, therefore always go to pages the worker
+ * itself touched first in trans_par_init(). Rows of A are split the
+ * same way there, which spreads A evenly across the nodes that read it.
+ *
+ * Workers, and the caller while the pool runs, are pinned to one CPU
+ * each, so first-touch placement still holds when the transpose runs.
+ * They wait on a condition variable between jobs rather than being
+ * created for every call.
+ */
+#define _GNU_SOURCE /* for pthread_setaffinity_np */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "trans-par.h"
+#include "trans-simd.h"
+
+/* The kinds of job the pool runs */
+#define JOB_INIT  0
+#define JOB_TRANS 1
+
+/* The pool, there is only one */
+static int pool_threads = 0;
+static pthread_t pool_tid[TRANS_MAX_THREADS];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned long pool_generation = 0;
+static int pool_pending = 0;
+static int pool_stopping = 0;
+static cpu_set_t caller_cpus;
+
+/* The job being run */
+static int job_kind, job_M, job_N;
+static int *job_A, *job_B;
+
+/* 
+ * band - Split [0, n) into pool_threads bands aligned to 8 and return
+ *     the start of band t, band pool_threads ending at n
+ */
+static int band(int n, int t) {
+    if (t >= pool_threads)
+        return n;
+    return (int)((long)n * t / pool_threads) & ~7;
+}
+
+/* 
+ * pin - Keep the calling thread on one CPU
+ */
+static void pin(int t) {
+    cpu_set_t set;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    CPU_ZERO(&set);
+    CPU_SET(t % (cpus > 0 ? cpus : 1), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* 
+ * run_part - Do worker t's share of the current job
+ */
+static void run_part(int t) {
+    int M = job_M, N = job_N;
+    int (*A)[M] = (int (*)[M])job_A;
+    int (*B)[N] = (int (*)[N])job_B;
+    int i, j;
+
+    if (job_kind == JOB_INIT) {
+        for (i = band(N, t); i < band(N, t + 1); ++i)
+            for (j = 0; j < M; ++j)
+                A[i][j] = (int)((long)i * M + j);
+        j = band(M, t);
+        memset(B[j], 0, sizeof(int) * N * (band(M, t + 1) - j));
+    } else {
+        trans_simd_cols(M, N, A, B, band(M, t), band(M, t + 1));
+    }
+}
+
+/* 
+ * worker - Body of pool thread t: wait for a new generation, run its
+ *     part and report back, until the pool stops
+ */
+static void *worker(void *arg) {
+    int t = (int)(long)arg;
+    unsigned long seen = 0;
+
+    pin(t);
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (pool_generation == seen && !pool_stopping)
+            pthread_cond_wait(&pool_start, &pool_lock);
+        if (pool_stopping)
+            break;
+        seen = pool_generation;
+        pthread_mutex_unlock(&pool_lock);
+
+        run_part(t);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--pool_pending == 0)
+            pthread_cond_signal(&pool_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+/* 
+ * run_job - Run the current job on every worker and the caller, and
+ *     return once all of them have finished
+ */
+static void run_job(void) {
+    pthread_mutex_lock(&pool_lock);
+    pool_pending = pool_threads - 1;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_part(0);
+
+    pthread_mutex_lock(&pool_lock);
+    while (pool_pending > 0)
+        pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int trans_pool_start(int threads) {
+    int t;
+
+    if (pool_threads || threads < 1 || threads > TRANS_MAX_THREADS)
+        return -1;
+    pool_stopping = 0;
+    pool_threads = threads;
+    pthread_getaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus);
+    pin(0);
+    for (t = 1; t < threads; t++) {
+        if (pthread_create(&pool_tid[t], NULL, worker, (void *)(long)t)) {
+            pool_threads = t;
+            trans_pool_stop();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void trans_pool_stop(void) {
+    int t;
+
+    pthread_mutex_lock(&pool_lock);
+    pool_stopping = 1;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
+    for (t = 1; t < pool_threads; t++)
+        pthread_join(pool_tid[t], NULL);
+    pool_threads = 0;
+    pthread_setaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus);
+}
+
+void trans_par_init(int M, int N, int A[N][M], int B[M][N]) {
+    int started = pool_threads;
+
+    if (!started)
+        trans_pool_start(1);
+    job_kind = JOB_INIT;
+    job_M = M;
+    job_N = N;
+    job_A = &A[0][0];
+    job_B = &B[0][0];
+    run_job();
+    if (!started)
+        trans_pool_stop();
+}
+
+void trans_par(int M, int N, int A[N][M], int B[M][N]) {
+    if (!pool_threads) {
+        trans_simd(M, N, A, B);
+        return;
+    }
+    job_kind = JOB_TRANS;
+    job_M = M;
+    job_N = N;
+    job_A = &A[0][0];
+    job_B = &B[0][0];
+    run_job();
+}
@@ -0,0 +1,30 @@
+/* 
+ * trans-par.h - Multithreaded tiled transpose for large matrices
+ *
+ * A fixed pool of worker threads splits B into contiguous bands of
+ * rows, one per worker, and each worker transposes the matching columns
+ * of A into its band with the kernels of trans-simd.c.
+ */
+
+#ifndef CACHELAB_TRANS_PAR_H
+#define CACHELAB_TRANS_PAR_H
+
+#define TRANS_MAX_THREADS 64
+
+/* Start a pool of threads workers (the caller counts as one), 0 on success */
+int trans_pool_start(int threads);
+
+/* Join the workers, the pool can then be started again */
+void trans_pool_stop(void);
+
+/* 
+ * Fill A with A[i][j] = i * M + j and clear B, each page written first
+ * by the worker that will use it, so that on a NUMA machine it is
+ * allocated on that worker's node.
+ */
+void trans_par_init(int M, int N, int A[N][M], int B[M][N]);
+
+/* B = A^T on the pool, a plain trans_simd() if it was never started */
+void trans_par(int M, int N, int A[N][M], int B[M][N]);
+
+#endif /* CACHELAB_TRANS_PAR_H */
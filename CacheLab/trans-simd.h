@@ -0,0 +1,41 @@
+/* 
+ * trans-simd.h - Vectorized transpose kernels for real hardware
+ *
+ * The kernels in trans.c minimize simulated misses; these ones minimize
+ * wall-clock time. They are compiled optimized and uninstrumented, so
+ * they are timed by test-trans -w rather than traced.
+ */
+
+#ifndef CACHELAB_TRANS_SIMD_H
+#define CACHELAB_TRANS_SIMD_H
+
+/* A kernel that test-trans -w can time */
+struct trans_kernel {
+    const char *description;
+    void (*func_ptr)(int M, int N, int A[N][M], int B[M][N]);
+    int (*available)(void);     /* NULL if it runs on any x86-64 */
+};
+
+/* NULL-terminated, scalar baselines first */
+extern struct trans_kernel trans_kernels[];
+
+/* Runtime CPU feature checks */
+int trans_have_avx2(void);
+
+/* Row-wise scan and 8 x 8 blocked scalar transposes, for comparison */
+void trans_scalar(int M, int N, int A[N][M], int B[M][N]);
+void trans_scalar_blocked(int M, int N, int A[N][M], int B[M][N]);
+
+/* 4 x 4 in-register tiles, SSE2 is part of every x86-64 */
+void trans_sse2(int M, int N, int A[N][M], int B[M][N]);
+
+/* 8 x 8 in-register tiles, only call if trans_have_avx2() */
+void trans_avx2(int M, int N, int A[N][M], int B[M][N]);
+
+/* Picks the widest kernel the running CPU supports */
+void trans_simd(int M, int N, int A[N][M], int B[M][N]);
+
+/* Same, but only columns [j0, j1) of A, into rows [j0, j1) of B */
+void trans_simd_cols(int M, int N, int A[N][M], int B[M][N], int j0, int j1);
+
+#endif /* CACHELAB_TRANS_SIMD_H */
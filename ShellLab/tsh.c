@@ -3,6 +3,7 @@
  * 
  * <Terry Xu>
  */
+#define _GNU_SOURCE         /* pipe2 and F_SETPIPE_SZ */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -12,13 +13,27 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 
 /* Misc manifest constants */
 #define MAXLINE    1024   /* max line size */
 #define MAXARGS     128   /* max args on a command line */
-#define MAXJOBS      16   /* max jobs at any point in time */
 #define MAXJID    1<<16   /* max job ID */
+#define MINBUCKETS   16   /* initial size of the job hash tables */
+#define MAXPROCS     64   /* max processes in a pipeline */
+#define PIPESIZE  (1<<20) /* pipe buffer size to ask the kernel for */
+#define CMDBUCKETS   64   /* buckets of the command hash table */
+#define INBUF     65536   /* input read at once by readcmd */
 
 /* Job states */
 #define UNDEF 0 /* undefined */
@@ -40,16 +55,93 @@
 extern char **environ;      /* defined in libc */
 char prompt[] = "tsh> ";    /* command line prompt (DO NOT CHANGE) */
 int verbose = 0;            /* if true, print additional output */
+int use_fork = 0;           /* if true, launch with fork and execve, not posix_spawn */
+int use_events = 0;         /* if true, take signals from sigfd in an event loop */
+int script = 0;             /* if true, run commands from a script, not a user */
+int sigfd = -1;             /* signalfd for SIGCHLD, SIGINT and SIGTSTP */
+int epfd = -1;              /* epoll set of the pidfds of live processes */
+sigset_t jobmask;           /* signal mask that jobs start with */
+volatile sig_atomic_t cancelled; /* ctrl-c typed with no foreground job */
 int nextjid = 1;            /* next job ID to allocate */
 char sbuf[MAXLINE];         /* for composing sprintf messages */
 
+struct task_t {             /* A command run by the parallel builtin */
+    int num;                /* its place in the argument lists, from 1 */
+    pid_t pgid;             /* its job's process group, 0 if the slot is free */
+    int done;               /* set when its job ends */
+    int status;             /* wait status of the job */
+    struct timespec start;  /* when it was started */
+    struct timespec end;    /* when its job ended */
+    struct rusage ru;       /* resources its job used */
+    char cmdline[MAXLINE];  /* command line */
+};
+
+struct proc_t {             /* One process of a job */
+    pid_t pid;              /* process PID */
+    int state;              /* the job's state, ST if stopped, UNDEF once reaped */
+    int pidfd;              /* pidfd in the epoll set, or -1 */
+    struct job_t *job;      /* the job it belongs to */
+    struct proc_t *pidnext; /* next process in the same pid hash bucket */
+};
+
 struct job_t {              /* The job struct */
-    pid_t pid;              /* job PID */
+    pid_t pid;              /* job PID, the process group of all its processes */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
+    int nprocs;             /* processes in the pipeline */
+    int nlive;              /* processes not yet reaped */
+    int status;             /* wait status of the last process */
+    struct proc_t procs[MAXPROCS]; /* the pipeline, in order */
+    struct task_t *task;    /* task to tell when it ends, or NULL */
+    struct timespec start;  /* when it was started */
+    struct rusage ru;       /* resources used by its reaped processes */
     char cmdline[MAXLINE];  /* command line */
+    struct job_t *jidnext;  /* next job in the same jid hash bucket */
+    struct job_t *prev;     /* neighbours in jid order, or the free list */
+    struct job_t *next;
+};
+
+/* 
+ * The job list. Jobs are found by jid, and by the pid of any of their
+ * processes, through hash tables chained through the jobs and their
+ * processes, and are kept on a list in jid order for listjobs and
+ * maxjid. Only addjob allocates: it grows the
+ * tables and takes new jobs from the heap with every signal blocked,
+ * so deletejob, which the SIGCHLD handler calls, never has to. Deleted
+ * jobs go on a free list for addjob to reuse.
+ */
+struct joblist_t {
+    struct proc_t **pidtab; /* pid hash buckets */
+    struct job_t **jidtab;  /* jid hash buckets */
+    int nbuckets;           /* size of both tables, a power of two */
+    int njobs;              /* jobs in the list */
+    int nprocs;             /* processes of those jobs */
+    struct job_t head;      /* sentinel of the list in jid order */
+    struct job_t *freelist; /* deleted jobs, chained through next */
+    struct job_t *fg;       /* the foreground job, if there is one */
+};
+struct joblist_t jobs;      /* The job list */
+
+/*
+ * The command hash table remembers where on PATH each command was
+ * found, so running it again needs no search. It is emptied when PATH
+ * changes.
+ */
+struct cmd_t {              /* A hashed command */
+    char *name;             /* the command as typed */
+    char *path;             /* the file PATH led to */
+    int hits;               /* times it has been run from the table */
+    struct cmd_t *next;     /* next command in the same bucket */
+};
+struct cmd_t *cmdtab[CMDBUCKETS]; /* The command hash table */
+char *cmdpath;              /* PATH the table was filled from */
+
+struct stage_t {            /* One command of a pipeline */
+    char **argv;            /* its argument list */
+    char *infile;           /* < file, or NULL */
+    char *outfile;          /* > file or >> file, or NULL */
+    int append;             /* true for >> */
 };
-struct job_t jobs[MAXJOBS]; /* The job list */
 /* End global variables */
 
 
@@ -57,9 +149,24 @@ struct job_t jobs[MAXJOBS]; /* The job list */
 
 /* Here are the functions that you will implement */
 void eval(char *cmdline);
+pid_t launch(struct stage_t *stages, int nstages, int state, char *cmdline,
+             struct task_t *task, int *jid);
+void timeself(struct task_t *task, struct rusage *before);
+pid_t execute(char **argv, int in, int out, pid_t pgid);
+pid_t spawn(char *path, char **argv, int in, int out, pid_t pgid, const sigset_t *mask);
+pid_t forkexec(char *path, char **argv, int in, int out, pid_t pgid, const sigset_t *mask);
 int builtin_cmd(char **argv);
 void do_bgfg(char **argv);
+void do_parallel(char **argv);
+void do_hash(char **argv);
+void do_wait(char **argv);
+int nextline(char *line);
 void waitfg(pid_t pid);
+int events(int want_stdin);
+void updatejob(pid_t pid, int status, const struct rusage *ru);
+void watchjob(struct job_t *job);
+void reapexits(void);
+int readcmd(char *cmdline);
 
 void sigchld_handler(int sig);
 void sigtstp_handler(int sig);
@@ -67,22 +174,31 @@ void sigint_handler(int sig);
 
 /* Here are helper routines that we've provided for you */
 int parseline(const char *cmdline, char **argv); 
+int parsepipe(char **argv, struct stage_t *stages);
 void sigquit_handler(int sig);
 
 void clearjob(struct job_t *job);
-void initjobs(struct job_t *jobs);
-int maxjid(struct job_t *jobs); 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid); 
-pid_t fgpid(struct job_t *jobs);
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
-struct job_t *getjobjid(struct job_t *jobs, int jid); 
+void initjobs(struct joblist_t *jobs);
+int maxjid(struct joblist_t *jobs); 
+int addjob(struct joblist_t *jobs, pid_t *pids, int npids, int state, char *cmdline);
+int deletejob(struct joblist_t *jobs, pid_t pid); 
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state);
+pid_t fgpid(struct joblist_t *jobs);
+struct proc_t *getproc(struct joblist_t *jobs, pid_t pid);
+struct job_t *getjobpid(struct joblist_t *jobs, pid_t pid);
+struct job_t *getjobjid(struct joblist_t *jobs, int jid); 
 int pid2jid(pid_t pid); 
-void listjobs(struct job_t *jobs);
+void listjobs(struct joblist_t *jobs, int usage);
+
+struct cmd_t *hashcmd(char *name, int *hashed);
+char *lookup(char *name, int *hashed);
+void unhash(char *name);
+void clearhash(void);
 
 void usage(void);
 void unix_error(char *msg);
 void app_error(char *msg);
+void printusage(const struct timespec *start, const struct timespec *end, const struct rusage *ru);
 
 /* Process control wrappers */
 pid_t Fork(void);
@@ -95,6 +211,7 @@ void Pause(void);
 unsigned int Alarm(unsigned int seconds);
 void Setpgid(pid_t pid, pid_t pgid);
 pid_t Getpgrp();
+void Pipe(int fds[2]);
 
 /* Signal wrappers */
 typedef void handler_t(int);
@@ -124,13 +241,14 @@ int main(int argc, char **argv) {
     int c;
     char cmdline[MAXLINE];
     int emit_prompt = 1; /* emit prompt (default) */
+    sigset_t mask;
 
     /* Redirect stderr to stdout (so that driver will get all output
      * on the pipe connected to stdout) */
     dup2(1, 2);
 
     /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF) {
+    while ((c = getopt(argc, argv, "hvpfes")) != EOF) {
         switch (c) {
             case 'h':             /* print help message */
                 usage();
@@ -141,6 +259,16 @@ int main(int argc, char **argv) {
             case 'p':             /* don't print a prompt */
                 emit_prompt = 0;  /* handy for automatic testing */
                 break;
+            case 'f':             /* launch jobs with fork and execve */
+                use_fork = 1;
+                break;
+            case 'e':             /* handle signals in an event loop */
+                use_events = 1;
+                break;
+            case 's':             /* run a script: no prompt, block reads */
+                script = 1;
+                emit_prompt = 0;
+                break;
             default:
                 usage();
 	    }
@@ -156,8 +284,30 @@ int main(int argc, char **argv) {
     /* This one provides a clean way to kill the shell */
     Signal(SIGQUIT, sigquit_handler);
 
+    /* 
+     * In the event loop the job control signals stay blocked and are
+     * read from sigfd, so the handlers run as ordinary functions. Jobs
+     * start with the mask the shell started with either way.
+     */
+    Sigemptyset(&mask);
+    if (use_events) {
+        Sigaddset(&mask, SIGCHLD);
+        Sigaddset(&mask, SIGINT);
+        Sigaddset(&mask, SIGTSTP);
+    }
+    Sigprocmask(SIG_BLOCK, &mask, &jobmask);
+    if (use_events && (sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+        unix_error("signalfd error");
+
+    /* Where the kernel has pidfds, the event loop waits on those instead */
+    if (use_events && (c = syscall(SYS_pidfd_open, getpid(), 0)) >= 0) {
+        close(c);
+        if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+            unix_error("epoll_create1 error");
+    }
+
     /* Initialize the job list */
-    initjobs(jobs);
+    initjobs(&jobs);
 
     /* Execute the shell's read/eval loop */
     while (1) {
@@ -167,17 +317,24 @@ int main(int argc, char **argv) {
             printf("%s", prompt);
             fflush(stdout);
         }
-        if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-            app_error("fgets error");
-        if (feof(stdin)) { /* End of file (ctrl-d) */
-            fflush(stdout);
-            exit(0);
+        if (use_events || script) {
+            if (!readcmd(cmdline)) { /* End of file (ctrl-d) */
+                fflush(stdout);
+                exit(0);
+            }
+        } else {
+            if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
+                app_error("fgets error");
+            if (feof(stdin)) { /* End of file (ctrl-d) */
+                fflush(stdout);
+                exit(0);
+            }
         }
 
-        /* Evaluate the command line */
+        /* Evaluate the command line; a script flushes only when it must */
         eval(cmdline);
-        fflush(stdout);
-        fflush(stdout);
+        if (!script)
+            fflush(stdout);
     } 
 
     exit(0); /* control never reaches here */
@@ -193,47 +350,307 @@ int main(int argc, char **argv) {
  * each child process must have a unique process group ID so that our
  * background children don't receive SIGINT (SIGTSTP) from the kernel
  * when we type ctrl-c (ctrl-z) at the keyboard.  
+ *
+ * Jobs are started with posix_spawn, which does not copy the shell's
+ * page tables the way fork does, unless the shell was started with -f.
+ *
+ * A command line that starts with "time" is run as it would be without
+ * it, and then what it used is printed, unless it is stopped first.
+ *
+ * A job may be a pipeline. Its stages are connected by pipes straight
+ * from one to the next, and all of them join the process group of the
+ * first, so that the job is signalled as a whole.
 */
 void eval(char *cmdline) {
     char *argv[MAXARGS]; /* Argument list execve() */
     char buf[MAXLINE];   /* Holds modified command line */
     int bg;              /* Should the job run in bg or fg? */
-    pid_t pid;           /* Process id */
+    struct stage_t stages[MAXPROCS]; /* Commands of the pipeline */
+    int nstages, i, out, saved, jid, timed;
+    struct task_t task;              /* What a timed command used */
+    struct rusage self;
+    struct job_t *job;
+    pid_t pgid;
+    sigset_t mask_all, prev;
+
+    strcpy(buf, cmdline);
+    bg = parseline(buf, argv);
+    if (argv[0] == NULL)
+        return;         /* Ignore empty lines */
+    if ((timed = !strcmp(argv[0], "time"))) {
+        for (i = 0; argv[i] != NULL; i++)
+            argv[i] = argv[i + 1];
+        if (argv[0] == NULL) {
+            printf("time command requires a command\n");
+            return;
+        }
+    }
+    if ((nstages = parsepipe(argv, stages)) == 0) {
+        printf("tsh: syntax error\n");
+        return;
+    }
+    task.done = 0;
+    clock_gettime(CLOCK_MONOTONIC, &task.start);
+    getrusage(RUSAGE_SELF, &self);
+
+    /* Builtins run in the shell, with stdout moved aside for a > */
+    if (nstages == 1 && stages[0].outfile == NULL && builtin_cmd(argv)) {
+        if (timed)
+            timeself(&task, &self);
+        return;
+    }
+    if (nstages == 1 && stages[0].outfile != NULL) {
+        fflush(stdout);
+        if ((out = open(stages[0].outfile, O_WRONLY | O_CREAT | O_CLOEXEC
+                        | (stages[0].append ? O_APPEND : O_TRUNC), 0666)) < 0) {
+            printf("%s: %s\n", stages[0].outfile, strerror(errno));
+            return;
+        }
+        saved = dup(1);
+        dup2(out, 1);
+        i = builtin_cmd(argv);
+        fflush(stdout);
+        dup2(saved, 1);
+        close(saved);
+        close(out);
+        if (i) {
+            if (timed)
+                timeself(&task, &self);
+            return;
+        }
+    }
+
+    if ((pgid = launch(stages, nstages, bg ? BG : FG, cmdline,
+                       timed && !bg ? &task : NULL, &jid)) == 0)
+        return;
+
+    /* Parent waits for foreground to terminate */
+    if (!bg) 
+        waitfg(pgid);
+    else
+        printf("[%d] (%d) %s", jid, pgid, cmdline);
+
+    /* A stopped job must not report to task once eval has returned */
+    if (timed && !bg) {
+        Sigfillset(&mask_all);
+        Sigprocmask(SIG_BLOCK, &mask_all, &prev);
+        if (task.done)
+            printusage(&task.start, &task.end, &task.ru);
+        else if ((job = getjobpid(&jobs, pgid)) != NULL)
+            job -> task = NULL;
+        Sigprocmask(SIG_SETMASK, &prev, NULL);
+    }
+
+    return;
+}
+
+/* 
+ * timeself - Print what a builtin timed from task -> start used, taking
+ *     the CPU time the shell had used then, before, from its own
+ */
+void timeself(struct task_t *task, struct rusage *before) {
+    getrusage(RUSAGE_SELF, &task -> ru);
+    clock_gettime(CLOCK_MONOTONIC, &task -> end);
+    timersub(&task -> ru.ru_utime, &before -> ru_utime, &task -> ru.ru_utime);
+    timersub(&task -> ru.ru_stime, &before -> ru_stime, &task -> ru.ru_stime);
+    printusage(&task -> start, &task -> end, &task -> ru);
+}
+
+/* 
+ * launch - Start the stages of a pipeline as a new job in the given
+ *     state, handing it task to fill in when it ends. Returns the job's
+ *     process group and sets *jid to its job ID, or returns 0 if none
+ *     of the stages could be started.
+ */
+pid_t launch(struct stage_t *stages, int nstages, int state, char *cmdline,
+             struct task_t *task, int *jid) {
+    pid_t pids[MAXPROCS];            /* Processes of the pipeline */
+    int npids, i;
+    int in, out, next, fds[2], ok;
+    pid_t pid, pgid;
+    struct timespec start;
 
     sigset_t mask_all, mask_one, prev;
     Sigfillset(&mask_all);
     Sigemptyset(&mask_one);
     Sigaddset(&mask_one, SIGCHLD);
+    Sigaddset(&mask_one, SIGINT);   /* held until the job is listed, or */
+    Sigaddset(&mask_one, SIGTSTP);  /* they find no fg job to go to */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fflush(stdout);     /* ahead of the job's output, and not into a fork */
+
+    Sigprocmask(SIG_BLOCK, &mask_one, &prev);    /* Block SIGCHLD, SIGINT, SIGTSTP */
+    npids = 0;
+    pgid = 0;
+    next = -1;
+    for (i = 0; i < nstages; i++) {
+        in = next;
+        out = next = -1;
+        if (i < nstages - 1) {
+            Pipe(fds);
+            out = fds[1];
+            next = fds[0];
+        }
 
-    strcpy(buf, cmdline);
-    bg = parseline(buf, argv);
-    if (argv[0] == NULL)
-        return;         /* Ignore empty lines */
-    
-    if (!builtin_cmd(argv)) {
-        Sigprocmask(SIG_BLOCK, &mask_one, &prev);    /* Block SIGCHLD */
-        if ((pid = Fork()) == 0) {  /* Child runs user job */
-            Sigprocmask(SIG_SETMASK, &prev, NULL);   /* Unblock SIGCHLD */
-            Setpgid(0, 0);
-            if (execve(argv[0], argv, environ) < 0) {
-                printf("%s: Command not found\n", argv[0]);
-                exit(0);
+        /* A redirection takes the place of the pipe on that side */
+        ok = 1;
+        if (stages[i].infile != NULL) {
+            if (in >= 0)
+                close(in);
+            if ((in = open(stages[i].infile, O_RDONLY | O_CLOEXEC)) < 0) {
+                printf("%s: %s\n", stages[i].infile, strerror(errno));
+                ok = 0;
             }
         }
-        
-        Sigprocmask(SIG_BLOCK, &mask_all, NULL);     /* Parent process */
-        addjob(jobs, pid, bg ? BG : FG, cmdline);    /* Add the child to the job list */
-        int jid = pid2jid(pid);                      /* Get jid */
-        Sigprocmask(SIG_SETMASK, &prev, NULL);      /* Unblock SIGCHLD */
-
-        /* Parent waits for foreground to terminate */
-        if (!bg) 
-            waitfg(pid);
-        else
-            printf("[%d] (%d) %s", jid, pid, cmdline);
+        if (ok && stages[i].outfile != NULL) {
+            if (out >= 0)
+                close(out);
+            if ((out = open(stages[i].outfile, O_WRONLY | O_CREAT | O_CLOEXEC
+                            | (stages[i].append ? O_APPEND : O_TRUNC), 0666)) < 0) {
+                printf("%s: %s\n", stages[i].outfile, strerror(errno));
+                ok = 0;
+            }
+        }
+
+        /* A stage that could not be set up is skipped, as if it had exited */
+        if (ok) {
+            if ((pid = execute(stages[i].argv, in, out, pgid)) > 0) {
+                pids[npids++] = pid;
+                if (pgid == 0)
+                    pgid = pid;
+            }
+        }
+        if (in >= 0)
+            close(in);
+        if (out >= 0)
+            close(out);
     }
 
-    return;
+    if (npids == 0) {
+        Sigprocmask(SIG_SETMASK, &prev, NULL);
+        return 0;
+    }
+    Sigprocmask(SIG_BLOCK, &mask_all, NULL);         /* Parent process */
+    addjob(&jobs, pids, npids, state, cmdline);      /* Add the job to the job list */
+    struct job_t *job = getjobpid(&jobs, pgid);
+    job -> task = task;
+    job -> start = start;
+    if (epfd >= 0)
+        watchjob(job);
+    *jid = job -> jid;                               /* Get jid */
+    Sigprocmask(SIG_SETMASK, &prev, NULL);           /* Unblock SIGCHLD */
+
+    return pgid;
+}
+
+/* 
+ * execute - Start argv[0], searching PATH for it unless it names a file.
+ *     A path from the command hash table that cannot be run any more is
+ *     forgotten and PATH searched again, and a command that fails to
+ *     run is not left in the table. Returns its pid, or 0 if it could
+ *     not be run.
+ */
+pid_t execute(char **argv, int in, int out, pid_t pgid) {
+    char *path;
+    int hashed;
+    pid_t pid;
+
+    while ((path = lookup(argv[0], &hashed)) != NULL) {
+        if (use_fork) {
+            /* The child's execve cannot report back, so check first */
+            if (hashed && access(path, X_OK) < 0) {
+                unhash(argv[0]);
+                continue;
+            }
+            return forkexec(path, argv, in, out, pgid, &jobmask);
+        }
+        if ((pid = spawn(path, argv, in, out, pgid, &jobmask)) != 0)
+            return pid;
+        unhash(argv[0]);
+        if (!hashed)
+            break;
+    }
+
+    printf("%s: Command not found\n", argv[0]);
+    return 0;
+}
+
+/* 
+ * spawn - Start path with arguments argv, its stdin and stdout on in and out (if
+ *     they are not -1) in process group pgid, or a new group of its own
+ *     if pgid is 0, with the signal mask set to mask and the job
+ *     control signals back at their default actions, as the forked
+ *     child would have. Returns its pid, or 0 if it could not be run.
+ */
+pid_t spawn(char *path, char **argv, int in, int out, pid_t pgid, const sigset_t *mask) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t defaults;
+    pid_t pid;
+    int rc;
+
+    Sigemptyset(&defaults);
+    Sigaddset(&defaults, SIGINT);
+    Sigaddset(&defaults, SIGTSTP);
+    Sigaddset(&defaults, SIGCHLD);
+    Sigaddset(&defaults, SIGQUIT);
+
+    if ((rc = posix_spawnattr_init(&attr)) != 0
+        || (rc = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+                                          | POSIX_SPAWN_SETSIGMASK
+                                          | POSIX_SPAWN_SETSIGDEF)) != 0
+        || (rc = posix_spawnattr_setpgroup(&attr, pgid)) != 0
+        || (rc = posix_spawnattr_setsigmask(&attr, mask)) != 0
+        || (rc = posix_spawnattr_setsigdefault(&attr, &defaults)) != 0) {
+        errno = rc;
+        unix_error("posix_spawnattr error");
+    }
+
+    /* in and out are close-on-exec, only their copies survive */
+    if ((rc = posix_spawn_file_actions_init(&actions)) != 0
+        || (in >= 0 && (rc = posix_spawn_file_actions_adddup2(&actions, in, 0)) != 0)
+        || (out >= 0 && (rc = posix_spawn_file_actions_adddup2(&actions, out, 1)) != 0)) {
+        errno = rc;
+        unix_error("posix_spawn_file_actions error");
+    }
+
+    /* Failing to exec is reported here, the child is already reaped */
+    rc = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) {
+        errno = rc;
+        return 0;
+    }
+    return pid;
+}
+
+/* 
+ * forkexec - The same as spawn, with fork and execve. A child that
+ *     cannot run path says so and exits, so the pid is never 0.
+ */
+pid_t forkexec(char *path, char **argv, int in, int out, pid_t pgid, const sigset_t *mask) {
+    pid_t pid;
+    int tty;
+
+    if ((pid = Fork()) == 0) {      /* Child runs user job */
+        Sigprocmask(SIG_SETMASK, mask, NULL);   /* Unblock SIGCHLD */
+        Setpgid(0, pgid);
+        tty = fcntl(1, F_DUPFD_CLOEXEC, 3);     /* the shell's stdout, for errors */
+        if (in >= 0)
+            dup2(in, 0);
+        if (out >= 0)
+            dup2(out, 1);
+        if (execve(path, argv, environ) < 0) {
+            dprintf(tty, "%s: Command not found\n", argv[0]);
+            exit(0);
+        }
+    }
+
+    /* Also from the parent, so the group exists before the next stage */
+    setpgid(pid, pgid ? pgid : pid);
+    return pid;
 }
 
 /* 
@@ -290,6 +707,48 @@ int parseline(const char *cmdline, char **argv) {
     return bg;
 }
 
+/* 
+ * parsepipe - Split the argv list built by parseline into the stages
+ *     of a pipeline at each "|", taking the redirections "< file",
+ *     "> file" and ">> file" out of the argument lists. The operators
+ *     must be words of their own. Returns the number of stages, or 0
+ *     if the pipeline is malformed.
+ */
+int parsepipe(char **argv, struct stage_t *stages) {
+    int nstages = 0;    /* stages seen so far */
+    char **dst = argv;  /* argv is compacted in place */
+    char **src;
+
+    stages[0].argv = dst;
+    stages[0].infile = stages[0].outfile = NULL;
+    stages[0].append = 0;
+    for (src = argv; *src; src++) {
+        if (!strcmp(*src, "|")) {
+            if (dst == stages[nstages].argv || nstages == MAXPROCS - 1)
+                return 0;
+            *dst++ = NULL;
+            nstages++;
+            stages[nstages].argv = dst;
+            stages[nstages].infile = stages[nstages].outfile = NULL;
+            stages[nstages].append = 0;
+        } else if (!strcmp(*src, "<")) {
+            if ((stages[nstages].infile = *++src) == NULL)
+                return 0;
+        } else if (!strcmp(*src, ">") || !strcmp(*src, ">>")) {
+            stages[nstages].append = (*src)[1] == '>';
+            if ((stages[nstages].outfile = *++src) == NULL)
+                return 0;
+        } else {
+            *dst++ = *src;
+        }
+    }
+    if (dst == stages[nstages].argv)
+        return 0;
+    *dst = NULL;
+
+    return nstages + 1;
+}
+
 /* 
  * builtin_cmd - If the user has typed a built-in command then execute
  *    it immediately.  
@@ -298,13 +757,25 @@ int builtin_cmd(char **argv) {
     if (!strcmp(argv[0], "quit"))                               /* quit command */
         exit(0);
     if (!strcmp(argv[0], "jobs")) {                             /* jobs command */
-        listjobs(jobs);
+        listjobs(&jobs, argv[1] != NULL && !strcmp(argv[1], "-l"));
         return 1;
     } 
     if (!strcmp(argv[0], "bg") || !strcmp(argv[0], "fg")) {     /* bg/fg command */
         do_bgfg(argv);
         return 1;
     }
+    if (!strcmp(argv[0], "wait")) {                             /* wait command */
+        do_wait(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "hash")) {                             /* hash command */
+        do_hash(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "parallel")) {                         /* parallel command */
+        do_parallel(argv);
+        return 1;
+    }
     if (!strcmp(argv[0], "&"))                                  /* ignore singleton & */
         return 1;
 
@@ -318,6 +789,7 @@ void do_bgfg(char **argv) {
     struct  job_t *job;
     pid_t pid;
     int jid;
+    sigset_t mask_all, prev;
 
     if (argv[1] == NULL) {
         printf("%s command requires PID or %%jobid argument\n", argv[0]);
@@ -326,7 +798,7 @@ void do_bgfg(char **argv) {
 
     if (argv[1][0] == '%') {
         jid = atoi(argv[1] + 1);
-        job = getjobjid(jobs, jid);
+        job = getjobjid(&jobs, jid);
         if (job) 
             pid = job -> pid;
         else {
@@ -334,7 +806,7 @@ void do_bgfg(char **argv) {
             return;
         }
     } else if ((pid = atoi(argv[1]))) {
-        job = getjobpid(jobs, pid);
+        job = getjobpid(&jobs, pid);
         if (job)
             jid = job -> jid;
         else {
@@ -346,19 +818,273 @@ void do_bgfg(char **argv) {
         return;
     }
 
+    /* Hold signals until the job is where ctrl-c and ctrl-z look for it */
+    Sigfillset(&mask_all);
+    Sigprocmask(SIG_BLOCK, &mask_all, &prev);
     Kill(-pid, SIGCONT);
 
     if (!strcmp(argv[0], "fg")) {
-        job -> state = FG;
+        setjobstate(&jobs, job, FG);
+        Sigprocmask(SIG_SETMASK, &prev, NULL);
         waitfg(pid);
     } else {
-        job -> state = BG;
+        setjobstate(&jobs, job, BG);
         printf("[%d] (%d) %s", jid, pid, job -> cmdline);
+        Sigprocmask(SIG_SETMASK, &prev, NULL);
     }
 
     return;
 }
 
+/* 
+ * do_parallel - Execute the builtin parallel command
+ *
+ *     parallel [-j n] command [args...] [::: arg...]
+ *
+ * runs the command once for each argument list, appended to its args.
+ * The lists are read from stdin, one per line up to a blank line, or
+ * are the single words after ":::". At most n of the commands (by
+ * default one per CPU) run at once, each as a background job, and the
+ * next is started as soon as SIGCHLD brings word that one has ended.
+ * Each is reported with its exit status and run time. ctrl-c stops
+ * new ones from starting and interrupts those that are running.
+ */
+void do_parallel(char **argv) {
+    char prefix[MAXLINE], line[MAXLINE], buf[MAXLINE];
+    char *cmdargv[MAXARGS];
+    struct stage_t stages[MAXPROCS];
+    struct task_t *tasks, *task;
+    struct timespec start, now;
+    char **args = NULL, **arg = argv + 1;
+    int nargs = 0, maxargs = 0, next, running, failed, killed;
+    int njobs, nstages, jid, i, len, fromargv;
+    sigset_t mask, prev;
+
+    njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (*arg && !strcmp(*arg, "-j")) {
+        if (arg[1] == NULL || (njobs = atoi(arg[1])) < 1) {
+            printf("%s: -j requires a positive number\n", argv[0]);
+            return;
+        }
+        arg += 2;
+    }
+    if (*arg == NULL || !strcmp(*arg, ":::")) {
+        printf("%s command requires a command to run\n", argv[0]);
+        return;
+    }
+
+    /* Copy the command out before parseline reuses its buffer */
+    for (len = 0; *arg && strcmp(*arg, ":::"); arg++)
+        len += snprintf(prefix + len, len < MAXLINE ? MAXLINE - len : 0,
+                        strchr(*arg, ' ') ? "'%s' " : "%s ", *arg);
+    if (len >= MAXLINE) {
+        printf("%s: command too long\n", argv[0]);
+        return;
+    }
+
+    /* Argument lists, after ::: or else from stdin */
+    if ((fromargv = *arg != NULL))
+        arg++;
+    while (1) {
+        if (fromargv) {
+            if (*arg == NULL)
+                break;
+            snprintf(line, MAXLINE, strchr(*arg, ' ') ? "'%s'" : "%s", *arg);
+            arg++;
+        } else if (!nextline(line) || line[0] == '\n') {
+            break;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if (nargs == maxargs) {
+            maxargs = maxargs ? 2 * maxargs : 16;
+            if ((args = realloc(args, maxargs * sizeof(char *))) == NULL)
+                unix_error("parallel error");
+        }
+        if ((args[nargs++] = strdup(line)) == NULL)
+            unix_error("parallel error");
+    }
+
+    if ((tasks = calloc(njobs, sizeof(struct task_t))) == NULL)
+        unix_error("parallel error");
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGCHLD);
+    Sigaddset(&mask, SIGINT);
+    cancelled = killed = 0;
+    next = running = failed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (next < nargs || running > 0) {
+        /* Fill the free slots */
+        for (task = tasks; task < tasks + njobs && next < nargs && !cancelled; task++) {
+            if (task -> pgid != 0)
+                continue;
+            task -> num = ++next;
+            task -> done = 0;
+            if (snprintf(task -> cmdline, MAXLINE, "%s%s\n", prefix, args[next - 1]) >= MAXLINE) {
+                printf("#%d: command too long\n", task -> num);
+                failed++;
+                continue;
+            }
+            strcpy(buf, task -> cmdline);
+            parseline(buf, cmdargv);
+            if ((nstages = parsepipe(cmdargv, stages)) == 0) {
+                printf("#%d: syntax error\n", task -> num);
+                failed++;
+                continue;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &task -> start);
+            if ((task -> pgid = launch(stages, nstages, BG, task -> cmdline, task, &jid)) == 0)
+                failed++;
+            else
+                running++;
+        }
+
+        /* ctrl-c: start no more, and pass it on to those running */
+        if (cancelled && !killed) {
+            next = nargs;
+            killed = 1;
+            Sigprocmask(SIG_BLOCK, &mask, &prev);
+            for (task = tasks; task < tasks + njobs; task++)
+                if (task -> pgid != 0 && !task -> done)
+                    kill(-task -> pgid, SIGINT);
+            Sigprocmask(SIG_SETMASK, &prev, NULL);
+        }
+        if (running == 0)
+            continue;
+
+        /* Wait for at least one to end */
+        Sigprocmask(SIG_BLOCK, &mask, &prev);
+        while (1) {
+            for (task = tasks; task < tasks + njobs; task++)
+                if (task -> pgid != 0 && task -> done)
+                    break;
+            if (task < tasks + njobs || (cancelled && !killed))
+                break;
+            if (use_events)
+                events(0);
+            else
+                Sigsuspend(&prev);
+        }
+        Sigprocmask(SIG_SETMASK, &prev, NULL);
+
+        for (task = tasks; task < tasks + njobs; task++) {
+            if (task -> pgid == 0 || !task -> done)
+                continue;
+            double secs = (task -> end.tv_sec - task -> start.tv_sec)
+                + (task -> end.tv_nsec - task -> start.tv_nsec) / 1e9;
+            if (WIFEXITED(task -> status))
+                printf("#%d (%d) exit %d in %.3fs: %s", task -> num, task -> pgid,
+                       WEXITSTATUS(task -> status), secs, task -> cmdline);
+            else
+                printf("#%d (%d) signal %d in %.3fs: %s", task -> num, task -> pgid,
+                       WTERMSIG(task -> status), secs, task -> cmdline);
+            if (!WIFEXITED(task -> status) || WEXITSTATUS(task -> status) != 0)
+                failed++;
+            task -> pgid = 0;
+            running--;
+        }
+        fflush(stdout);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("parallel: %d commands, %d failed, %.3fs\n", nargs, failed,
+           (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9);
+    for (i = 0; i < nargs; i++)
+        free(args[i]);
+    free(args);
+    free(tasks);
+}
+
+/* 
+ * nextline - Read a line of input the way the shell's main loop does.
+ *     Returns 0 at end of file.
+ */
+int nextline(char *line) {
+    if (use_events || script)
+        return readcmd(line);
+    return fgets(line, MAXLINE, stdin) != NULL;
+}
+
+/* 
+ * do_hash - Execute the builtin hash command: list the command hash
+ *     table, empty it with -r, or look up the commands named afresh
+ */
+void do_hash(char **argv) {
+    struct cmd_t *cmd;
+    int i, hashed, empty = 1;
+
+    if (argv[1] == NULL) {
+        hashcmd("", &hashed);   /* forgets everything if PATH has changed */
+        for (i = 0; i < CMDBUCKETS; i++) {
+            for (cmd = cmdtab[i]; cmd != NULL; cmd = cmd -> next) {
+                if (empty)
+                    printf("hits\tcommand\n");
+                empty = 0;
+                printf("%4d\t%s\n", cmd -> hits, cmd -> path);
+            }
+        }
+        if (empty)
+            printf("%s: hash table empty\n", argv[0]);
+        return;
+    }
+
+    if (!strcmp(argv[1], "-r")) {
+        clearhash();
+        return;
+    }
+
+    for (i = 1; argv[i] != NULL; i++) {
+        if (strchr(argv[i], '/'))
+            continue;
+        unhash(argv[i]);
+        if (hashcmd(argv[i], &hashed) == NULL)
+            printf("%s: %s: not found\n", argv[0], argv[i]);
+    }
+}
+
+/* 
+ * do_wait - Execute the builtin wait command: block until the jobs
+ *     named by PID or %jobid, or else all background jobs, are done.
+ *     Stopped jobs are not waited for, and ctrl-c ends the wait.
+ */
+void do_wait(char **argv) {
+    struct job_t *job;
+    sigset_t mask, prev;
+    int i, busy;
+
+    for (i = 1; argv[i] != NULL; i++) {
+        if (argv[i][0] == '%' ? getjobjid(&jobs, atoi(argv[i] + 1)) == NULL
+                              : getjobpid(&jobs, atoi(argv[i])) == NULL)
+            printf("%s: %s: No such job\n", argv[0], argv[i]);
+    }
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGCHLD);
+    Sigaddset(&mask, SIGINT);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    cancelled = 0;
+    while (!cancelled) {
+        busy = 0;
+        if (argv[1] == NULL) {
+            for (job = jobs.head.next; job != &jobs.head; job = job -> next)
+                busy |= job -> state == BG;
+        } else {
+            for (i = 1; argv[i] != NULL; i++) {
+                job = argv[i][0] == '%' ? getjobjid(&jobs, atoi(argv[i] + 1))
+                                        : getjobpid(&jobs, atoi(argv[i]));
+                busy |= job != NULL && job -> state == BG;
+            }
+        }
+        if (!busy)
+            break;
+        if (use_events)
+            events(0);
+        else
+            Sigsuspend(&prev);
+    }
+    Sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
 /* 
  * waitfg - Block until process pid is no longer the foreground process
  */
@@ -366,8 +1092,12 @@ void waitfg(pid_t pid) {
     sigset_t mask_empty;
     Sigemptyset(&mask_empty);
 
-    while (fgpid(jobs) == pid) 
-        Sigsuspend(&mask_empty);
+    if (use_events)
+        while (fgpid(&jobs) == pid)
+            events(0);
+    else
+        while (fgpid(&jobs) == pid) 
+            Sigsuspend(&mask_empty);
 
     if (verbose)
         printf("waitfg: Process (%d) no longer the fg process", pid);
@@ -375,6 +1105,204 @@ void waitfg(pid_t pid) {
     return;
 }
 
+/* 
+ * updatejob - Record that process pid has changed to the wait status
+ *     status. A pipeline stops as soon as any of its processes stops,
+ *     and is deleted once all of them are gone. How it ended is how its
+ *     last process ended. What a process that has ended used, ru, is
+ *     added to what its job has used. Call with every signal blocked.
+ */
+void updatejob(pid_t pid, int status, const struct rusage *ru) {
+    struct proc_t *proc = getproc(&jobs, pid);
+    struct job_t *job;
+
+    if (proc == NULL)
+        return;
+    job = proc -> job;
+    int jid = job -> jid;
+    pid_t pgid = job -> pid;
+
+    if (WIFSTOPPED(status)) {
+        proc -> state = ST;
+        if (job -> state != ST) {
+            setjobstate(&jobs, job, ST);
+            printf("Job [%d] (%d) stopped by signal %d\n", jid, pgid, WSTOPSIG(status));
+        }
+    } else {
+        proc -> state = UNDEF;
+        if (proc == &job -> procs[job -> nprocs - 1])
+            job -> status = status;
+        if (ru != NULL) {
+            timeradd(&job -> ru.ru_utime, &ru -> ru_utime, &job -> ru.ru_utime);
+            timeradd(&job -> ru.ru_stime, &ru -> ru_stime, &job -> ru.ru_stime);
+            if (ru -> ru_maxrss > job -> ru.ru_maxrss)
+                job -> ru.ru_maxrss = ru -> ru_maxrss;
+        }
+        if (--job -> nlive == 0) {
+            status = job -> status;
+            if (job -> task) {
+                job -> task -> status = status;
+                job -> task -> ru = job -> ru;
+                clock_gettime(CLOCK_MONOTONIC, &job -> task -> end);
+                job -> task -> done = 1;
+            }
+            deletejob(&jobs, pid);
+            if (verbose)
+                printf("sigchld_handler: Job [%d] (%d) deleted\n", jid, pgid);
+            if (WIFEXITED(status) && verbose)
+                printf("sigchld_handler: Job [%d] (%d) terminates OK (status %d)\n", jid, pgid, WEXITSTATUS(status));
+            if (WIFSIGNALED(status))
+                printf("Job [%d] (%d) terminated by signal %d\n", jid, pgid, WTERMSIG(status));
+        }
+    }
+}
+
+/* 
+ * watchjob - Open a pidfd for each process of a new job and add it to
+ *     the epoll set, so that the event loop hears of exactly these
+ *     processes exiting. A zombie's pidfd is readable at once.
+ */
+void watchjob(struct job_t *job) {
+    struct epoll_event ev;
+    struct proc_t *proc;
+
+    for (proc = job -> procs; proc < job -> procs + job -> nprocs; proc++) {
+        if ((proc -> pidfd = syscall(SYS_pidfd_open, proc -> pid, 0)) < 0)
+            unix_error("pidfd_open error");
+        ev.events = EPOLLIN;
+        ev.data.ptr = proc;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, proc -> pidfd, &ev) < 0)
+            unix_error("epoll_ctl error");
+    }
+}
+
+/* 
+ * reapexits - Reap the processes whose pidfds are readable in the epoll
+ *     set. Closing a pidfd also takes it out of the set.
+ */
+void reapexits(void) {
+    struct epoll_event evs[64];
+    struct proc_t *proc;
+    struct rusage ru;
+    siginfo_t info;
+    sigset_t mask_all, prev_all;
+    int n, i, status;
+
+    Sigfillset(&mask_all);
+    do {
+        if ((n = epoll_wait(epfd, evs, 64, 0)) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("epoll_wait error");
+        }
+        Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+        for (i = 0; i < n; i++) {
+            proc = evs[i].data.ptr;
+            info.si_pid = 0;
+            /* The waitid system call, unlike the libc one, returns rusage */
+            if (syscall(SYS_waitid, P_PIDFD, proc -> pidfd, &info, WEXITED | WNOHANG, &ru) < 0
+                || info.si_pid == 0)
+                continue;
+            close(proc -> pidfd);
+            proc -> pidfd = -1;
+            if (info.si_code == CLD_EXITED)
+                status = W_EXITCODE(info.si_status, 0);
+            else
+                status = W_EXITCODE(0, info.si_status) | (info.si_code == CLD_DUMPED ? WCOREFLAG : 0);
+            updatejob(info.si_pid, status, &ru);
+        }
+        Sigprocmask(SIG_SETMASK, &prev_all, NULL);
+    } while (n == 64);
+}
+
+/* 
+ * events - Wait until one of the job control signals arrives, a watched
+ *     process exits, or stdin becomes readable if want_stdin, and handle
+ *     every signal queued on sigfd and every exit in the epoll set.
+ *     However many children changed state, the SIGCHLD handler runs
+ *     once and reaps them all. Returns true if stdin is readable.
+ */
+int events(int want_stdin) {
+    struct pollfd fds[3];
+    struct signalfd_siginfo info[16];
+    int chld = 0, intr = 0, tstp = 0;
+    ssize_t n, i;
+
+    /* stdin goes last, so it can be left out */
+    fds[0].fd = sigfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = epfd;       /* ignored by poll if -1 */
+    fds[1].events = POLLIN;
+    fds[2].fd = 0;
+    fds[2].events = POLLIN;
+    while (poll(fds, want_stdin ? 3 : 2, -1) < 0)
+        if (errno != EINTR)
+            unix_error("poll error");
+
+    while ((n = read(sigfd, info, sizeof(info))) > 0) {
+        for (i = 0; i < n / (ssize_t)sizeof(info[0]); i++) {
+            chld |= info[i].ssi_signo == SIGCHLD;
+            intr |= info[i].ssi_signo == SIGINT;
+            tstp |= info[i].ssi_signo == SIGTSTP;
+        }
+    }
+    if (n < 0 && errno != EAGAIN)
+        unix_error("signalfd read error");
+
+    /* Reap first, so a signal is never forwarded to a finished job */
+    if (fds[1].revents & POLLIN)
+        reapexits();
+    if (chld)
+        sigchld_handler(SIGCHLD);
+    if (intr)
+        sigint_handler(SIGINT);
+    if (tstp)
+        sigtstp_handler(SIGTSTP);
+
+    return want_stdin && (fds[2].revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+/* 
+ * readcmd - Read the next command line for the event loop or a script.
+ *     Input is read in blocks of up to INBUF, and every whole line in
+ *     the block is handed out before reading again, so a script costs
+ *     one read for many commands and poll sees every line that stdio
+ *     would have buffered. Nothing written since the last command is
+ *     held back while the shell waits for more. Like fgets, a line is
+ *     cut at MAXLINE-1 characters. Returns 0 at end of file.
+ */
+int readcmd(char *cmdline) {
+    static char buf[INBUF];     /* input read past the last line */
+    static size_t start, len;   /* which is buf[start..start+len) */
+    char *nl;
+    size_t n;
+    ssize_t rc;
+
+    while ((nl = memchr(buf + start, '\n', len < MAXLINE - 1 ? len : MAXLINE - 1)) == NULL
+           && len < MAXLINE - 1) {
+        memmove(buf, buf + start, len);
+        start = 0;
+        fflush(stdout);
+        if (use_events && !events(1))
+            continue;
+        if ((rc = read(0, buf + len, INBUF - len)) < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            unix_error("read error");
+        }
+        if (rc == 0)
+            return 0;   /* an unfinished last line is dropped, as with fgets */
+        len += rc;
+    }
+
+    n = nl ? (size_t)(nl - (buf + start)) + 1 : MAXLINE - 1;
+    memcpy(cmdline, buf + start, n);
+    cmdline[n] = '\0';
+    start += n;
+    len -= n;
+    return 1;
+}
+
 /*****************
  * Signal handlers
  *****************/
@@ -385,10 +1313,15 @@ void waitfg(pid_t pid) {
  *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
  *     available zombie children, but doesn't wait for any other
  *     currently running children to terminate.  
+ *
+ *     When the event loop watches pidfds, it reaps exits itself and the
+ *     handler only looks for stopped children.
  */
 void sigchld_handler(int sig) {
     int olderrno = errno;
     sigset_t mask_all, prev_all;
+    struct rusage ru;
+    siginfo_t info;
     pid_t pid;
     int status;
 
@@ -396,30 +1329,20 @@ void sigchld_handler(int sig) {
         Sio_puts("sigchld_handler: entering\n");
 
     Sigfillset(&mask_all);
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
-        int jid = pid2jid(pid);
-        Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
-
-        if (WIFEXITED(status)) {
-            deletejob(jobs, pid);
-            if (verbose) {
-                printf("sigchld_handler: Job [%d] (%d) deleted\n", jid, pid);
-                printf("sigchld_handler: Job [%d] (%d) terminates OK (status %d)\n", jid, pid, WEXITSTATUS(status));
-            }
-            
+    if (epfd >= 0) {
+        /* Exits are read from the pidfds, only stops are left to find */
+        while ((info.si_pid = 0, pid = waitid(P_ALL, 0, &info, WSTOPPED | WNOHANG)) == 0
+               && info.si_pid != 0) {
+            Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+            updatejob(info.si_pid, W_STOPCODE(info.si_status), NULL);
+            Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
-        if (WIFSTOPPED(status)) {
-            getjobpid(jobs, pid) -> state = ST;
-            printf("Job [%d] (%d) stopped by signal %d\n", jid, pid, WSTOPSIG(status));
-        }
-        if (WIFSIGNALED(status)) {
-            deletejob(jobs, pid);
-            if (verbose)
-                printf("sigchld_handler: Job [%d] (%d) deleted\n", jid, pid);
-            printf("Job [%d] (%d) terminated by signal %d\n", jid, pid, WTERMSIG(status));
+    } else {
+        while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &ru)) > 0) {
+            Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+            updatejob(pid, status, &ru);
+            Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
-        
-        Sigprocmask(SIG_SETMASK, &prev_all, NULL);
     }
 
     if (pid == -1 && errno != ECHILD)
@@ -446,8 +1369,10 @@ void sigint_handler(int sig) {
     int olderrno = errno;
     int fg_pid;
 
-    if ((fg_pid = fgpid(jobs)))
+    if ((fg_pid = fgpid(&jobs)))
         Kill(-fg_pid, SIGINT);
+    else
+        cancelled = 1;
     if (verbose)
         printf("sigint_handler: Job (%d) killed", fg_pid);
 
@@ -471,7 +1396,7 @@ void sigtstp_handler(int sig) {
     int olderrno = errno;
     int fg_pid, jid;
 
-    if ((fg_pid = fgpid(jobs))) {
+    if ((fg_pid = fgpid(&jobs))) {
         jid = pid2jid(fg_pid);
         Kill(-fg_pid, SIGTSTP);
     }
@@ -498,142 +1423,254 @@ void clearjob(struct job_t *job) {
     job -> pid = 0;
     job -> jid = 0;
     job -> state = UNDEF;
+    job -> nprocs = job -> nlive = 0;
+    job -> status = 0;
+    job -> task = NULL;
+    memset(&job -> ru, 0, sizeof(job -> ru));
     job -> cmdline[0] = '\0';
+    job -> jidnext = NULL;
 }
 
-/* initjobs - Initialize the job list */
-void initjobs(struct job_t *jobs) {
-    int i;
+/* pidhash, jidhash - Hash table buckets of a pid and of a jid */
+static struct proc_t **pidhash(struct joblist_t *jobs, pid_t pid) {
+    return &jobs -> pidtab[(unsigned)pid * 2654435761u & (jobs -> nbuckets - 1)];
+}
 
-    for (i = 0; i < MAXJOBS; i++)
-	    clearjob(&jobs[i]);
+static struct job_t **jidhash(struct joblist_t *jobs, int jid) {
+    return &jobs -> jidtab[(unsigned)jid & (jobs -> nbuckets - 1)];
 }
 
-/* maxjid - Returns largest allocated job ID */
-int maxjid(struct job_t *jobs) {
-    int i, max=0;
+/* rehash - Resize both hash tables to nbuckets buckets */
+static void rehash(struct joblist_t *jobs, int nbuckets) {
+    struct job_t *job;
+    struct proc_t *proc;
+    struct proc_t **pidtab = calloc(nbuckets, sizeof(struct proc_t *));
+    struct job_t **jidtab = calloc(nbuckets, sizeof(struct job_t *));
+
+    if (pidtab == NULL || jidtab == NULL)
+        unix_error("rehash error");
+    free(jobs -> pidtab);
+    free(jobs -> jidtab);
+    jobs -> pidtab = pidtab;
+    jobs -> jidtab = jidtab;
+    jobs -> nbuckets = nbuckets;
+    for (job = jobs -> head.next; job != &jobs -> head; job = job -> next) {
+        for (proc = job -> procs; proc < job -> procs + job -> nprocs; proc++) {
+            proc -> pidnext = *pidhash(jobs, proc -> pid);
+            *pidhash(jobs, proc -> pid) = proc;
+        }
+        job -> jidnext = *jidhash(jobs, job -> jid);
+        *jidhash(jobs, job -> jid) = job;
+    }
+}
 
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].jid > max)
-            max = jobs[i].jid;
-    return max;
+/* initjobs - Initialize the job list */
+void initjobs(struct joblist_t *jobs) {
+    jobs -> pidtab = NULL;
+    jobs -> jidtab = NULL;
+    jobs -> njobs = jobs -> nprocs = 0;
+    jobs -> head.prev = jobs -> head.next = &jobs -> head;
+    jobs -> freelist = NULL;
+    jobs -> fg = NULL;
+    rehash(jobs, MINBUCKETS);
 }
 
-/* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) {
-    int i;
+/* maxjid - Returns largest allocated job ID */
+int maxjid(struct joblist_t *jobs) {
+    return jobs -> head.prev -> jid;    /* 0 in the sentinel */
+}
+
+/* addjob - Add a job of the npids processes pids[] to the job list */
+int addjob(struct joblist_t *jobs, pid_t *pids, int npids, int state, char *cmdline) {
+    struct job_t *job, *after;
+    struct proc_t *proc;
+    int i, nbuckets;
     
-    if (pid < 1)
+    if (npids < 1 || npids > MAXPROCS || pids[0] < 1)
 	    return 0;
 
-    for (i = 0; i < MAXJOBS; i++) {
-        if (jobs[i].pid == 0) {
-            jobs[i].pid = pid;
-            jobs[i].state = state;
-            jobs[i].jid = nextjid++;
-            if (nextjid > MAXJOBS)
-                nextjid = 1;
-            strcpy(jobs[i].cmdline, cmdline);
-            if(verbose) 
-                printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
-            
-            return 1;
-        }
-    }
-    printf("Tried to create too many jobs\n");
-    return 0;
-}
+    for (nbuckets = jobs -> nbuckets; jobs -> nprocs + npids > nbuckets; nbuckets *= 2)
+        ;
+    if (nbuckets != jobs -> nbuckets)
+        rehash(jobs, nbuckets);
+    if ((job = jobs -> freelist) != NULL)
+        jobs -> freelist = job -> next;
+    else if ((job = malloc(sizeof(struct job_t))) == NULL) {
+        printf("Tried to create too many jobs\n");
+        return 0;
+    }
 
-/* deletejob - Delete a job whose PID=pid from the job list */
-int deletejob(struct job_t *jobs, pid_t pid) {
-    int i;
+    /* A job ID that wrapped around may still be in use */
+    while (getjobjid(jobs, nextjid) != NULL)
+        if (++nextjid > MAXJID)
+            nextjid = 1;
+
+    clearjob(job);
+    job -> pid = pids[0];
+    job -> state = state;
+    job -> jid = nextjid++;
+    if (nextjid > MAXJID)
+        nextjid = 1;
+    strcpy(job -> cmdline, cmdline);
+
+    /* Almost always the largest job ID, so this rarely walks */
+    for (after = jobs -> head.prev; after != &jobs -> head && after -> jid > job -> jid; after = after -> prev)
+        ;
+    job -> prev = after;
+    job -> next = after -> next;
+    after -> next -> prev = job;
+    after -> next = job;
+
+    for (i = 0; i < npids; i++) {
+        proc = &job -> procs[i];
+        proc -> pid = pids[i];
+        proc -> state = state;
+        proc -> pidfd = -1;
+        proc -> job = job;
+        proc -> pidnext = *pidhash(jobs, pids[i]);
+        *pidhash(jobs, pids[i]) = proc;
+    }
+    job -> nprocs = job -> nlive = npids;
+    jobs -> nprocs += npids;
+    job -> jidnext = *jidhash(jobs, job -> jid);
+    *jidhash(jobs, job -> jid) = job;
+    jobs -> njobs++;
+    if (state == FG)
+        jobs -> fg = job;
+
+    if(verbose) 
+        printf("Added job [%d] %d %s\n", job -> jid, job -> pid, job -> cmdline);
+    return 1;
+}
 
-    if (pid < 1)
-	    return 0;
+/* deletejob - Delete the job with a process PID=pid from the job list */
+int deletejob(struct joblist_t *jobs, pid_t pid) {
+    struct job_t **link, *job;
+    struct proc_t **plink, *proc;
 
-    for (i = 0; i < MAXJOBS; i++) {
-        if (jobs[i].pid == pid) {
-            clearjob(&jobs[i]);
-            nextjid = maxjid(jobs) + 1;
+    if ((job = getjobpid(jobs, pid)) == NULL)
+        return 0;
 
-            return 1;
-        }
+    /* A reused pid is hashed in front of a reaped one, so match the proc */
+    for (proc = job -> procs; proc < job -> procs + job -> nprocs; proc++) {
+        for (plink = pidhash(jobs, proc -> pid); *plink != proc; plink = &(*plink) -> pidnext)
+            ;
+        *plink = proc -> pidnext;
     }
-    return 0;
+    jobs -> nprocs -= job -> nprocs;
+
+    for (link = jidhash(jobs, job -> jid); *link != job; link = &(*link) -> jidnext)
+        ;
+    *link = job -> jidnext;
+
+    job -> prev -> next = job -> next;
+    job -> next -> prev = job -> prev;
+    if (jobs -> fg == job)
+        jobs -> fg = NULL;
+    jobs -> njobs--;
+
+    clearjob(job);
+    job -> next = jobs -> freelist;
+    jobs -> freelist = job;
+    nextjid = maxjid(jobs) + 1;
+    return 1;
 }
 
-/* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jobs) {
-    int i;
+/* setjobstate - Change the state of a job, tracking the foreground job */
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state) {
+    struct proc_t *proc;
+
+    job -> state = state;
+    if (state != ST)    /* continued, so none of its processes is stopped */
+        for (proc = job -> procs; proc < job -> procs + job -> nprocs; proc++)
+            if (proc -> state != UNDEF)
+                proc -> state = state;
+    if (state == FG)
+        jobs -> fg = job;
+    else if (jobs -> fg == job)
+        jobs -> fg = NULL;
+}
 
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].state == FG)
-            return jobs[i].pid;
-    return 0;
+/* fgpid - Return PID of current foreground job, 0 if no such job */
+pid_t fgpid(struct joblist_t *jobs) {
+    return jobs -> fg ? jobs -> fg -> pid : 0;
 }
 
-/* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid) {
-    int i;
+/* getproc - Find a process of a job (by PID) on the job list */
+struct proc_t *getproc(struct joblist_t *jobs, pid_t pid) {
+    struct proc_t *proc;
 
     if (pid < 1)
         return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].pid == pid)
-            return &jobs[i];
+    for (proc = *pidhash(jobs, pid); proc != NULL; proc = proc -> pidnext)
+        if (proc -> pid == pid)
+            return proc;
     return NULL;
 }
 
+/* getjobpid  - Find a job (by the PID of any of its processes) on the job list */
+struct job_t *getjobpid(struct joblist_t *jobs, pid_t pid) {
+    struct proc_t *proc = getproc(jobs, pid);
+
+    return proc ? proc -> job : NULL;
+}
+
 /* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jobs, int jid) {
-    int i;
+struct job_t *getjobjid(struct joblist_t *jobs, int jid) {
+    struct job_t *job;
 
     if (jid < 1)
 	    return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].jid == jid)
-            return &jobs[i];
+    for (job = *jidhash(jobs, jid); job != NULL; job = job -> jidnext)
+        if (job -> jid == jid)
+            return job;
     return NULL;
 }
 
 /* pid2jid - Map process ID to job ID */
 int pid2jid(pid_t pid) {
-    int i;
+    struct job_t *job = getjobpid(&jobs, pid);
 
-    if (pid < 1)
-	    return 0;
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].pid == pid) 
-            return jobs[i].jid;
-        
-    return 0;
+    return job ? job -> jid : 0;
 }
 
-/* listjobs - Print the job list */
-void listjobs(struct job_t *jobs) {
-    int i;
+/* 
+ * listjobs - Print the job list, and if usage is set, the pids of each
+ *     job and what it has used so far. CPU time and memory are only
+ *     known for processes that have been reaped.
+ */
+void listjobs(struct joblist_t *jobs, int usage) {
+    struct job_t *job;
+    struct proc_t *proc;
+    struct timespec now;
     
-    for (i = 0; i < MAXJOBS; i++) {
-        if (jobs[i].pid != 0) {
-            printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-            switch (jobs[i].state) {
-                case BG: 
-                    printf("Running ");
-                    break;
-                case FG: 
-                    printf("Foreground ");
-                    break;
-                case ST: 
-                    printf("Stopped ");
-                    break;
-                default:
-                    printf(
-                        "listjobs: Internal error: job[%d].state=%d ", 
-                        i, 
-                        jobs[i].state
-                    );
-            }
-            printf("%s", jobs[i].cmdline);
+    for (job = jobs -> head.next; job != &jobs -> head; job = job -> next) {
+        printf("[%d] (%d) ", job -> jid, job -> pid);
+        switch (job -> state) {
+            case BG: 
+                printf("Running ");
+                break;
+            case FG: 
+                printf("Foreground ");
+                break;
+            case ST: 
+                printf("Stopped ");
+                break;
+            default:
+                printf(
+                    "listjobs: Internal error: job[%d].state=%d ", 
+                    job -> jid, 
+                    job -> state
+                );
+        }
+        printf("%s", job -> cmdline);
+        if (usage) {
+            printf("   ");
+            for (proc = job -> procs; proc < job -> procs + job -> nprocs; proc++)
+                printf(" %d%s", proc -> pid, proc -> state == UNDEF ? "(done)" : "");
+            printf("\n    ");
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            printusage(&job -> start, &now, &job -> ru);
         }
     }
 }
@@ -642,6 +1679,120 @@ void listjobs(struct job_t *jobs) {
  ******************************/
 
 
+/*********************************************
+ * Helper routines for the command hash table
+ ********************************************/
+
+/* cmdhash - Hash table bucket of a command name */
+static struct cmd_t **cmdhash(char *name) {
+    unsigned h = 5381;
+
+    while (*name)
+        h = h * 33 + (unsigned char)*name++;
+    return &cmdtab[h & (CMDBUCKETS - 1)];
+}
+
+/* 
+ * hashcmd - Find command name in the table, setting *hashed, or else
+ *     search PATH for it and add what is found. An empty directory on
+ *     PATH is the current one. Returns NULL if name is not on PATH.
+ */
+struct cmd_t *hashcmd(char *name, int *hashed) {
+    char *path = getenv("PATH");
+    char file[MAXLINE];
+    char *dir, *end;
+    struct cmd_t *cmd;
+    struct stat sb;
+
+    if (path == NULL)
+        path = "";
+    if (cmdpath == NULL || strcmp(cmdpath, path)) {
+        clearhash();
+        if ((cmdpath = strdup(path)) == NULL)
+            unix_error("hash error");
+    }
+
+    *hashed = 0;
+    for (cmd = *cmdhash(name); cmd != NULL; cmd = cmd -> next) {
+        if (!strcmp(cmd -> name, name)) {
+            *hashed = 1;
+            return cmd;
+        }
+    }
+    if (*name == '\0')
+        return NULL;
+
+    for (dir = path; ; dir = end + 1) {
+        end = strchrnul(dir, ':');
+        if (snprintf(file, MAXLINE, "%.*s/%s", end > dir ? (int)(end - dir) : 1,
+                     end > dir ? dir : ".", name) < MAXLINE
+            && access(file, X_OK) == 0 && stat(file, &sb) == 0 && S_ISREG(sb.st_mode)) {
+            if ((cmd = malloc(sizeof(struct cmd_t))) == NULL
+                || (cmd -> name = strdup(name)) == NULL
+                || (cmd -> path = strdup(file)) == NULL)
+                unix_error("hash error");
+            cmd -> hits = 0;
+            cmd -> next = *cmdhash(name);
+            *cmdhash(name) = cmd;
+            return cmd;
+        }
+        if (*end == '\0')
+            return NULL;
+    }
+}
+
+/* 
+ * lookup - The file to run for command name: name itself if it has a
+ *     slash in it, else where PATH leads, from the table if it is there
+ *     (then *hashed is set). Returns NULL if there is none.
+ */
+char *lookup(char *name, int *hashed) {
+    struct cmd_t *cmd;
+
+    *hashed = 0;
+    if (strchr(name, '/'))
+        return name;
+    if ((cmd = hashcmd(name, hashed)) == NULL)
+        return NULL;
+    cmd -> hits++;
+    return cmd -> path;
+}
+
+/* unhash - Forget where command name was found */
+void unhash(char *name) {
+    struct cmd_t **link, *cmd;
+
+    for (link = cmdhash(name); (cmd = *link) != NULL; link = &cmd -> next) {
+        if (!strcmp(cmd -> name, name)) {
+            *link = cmd -> next;
+            free(cmd -> name);
+            free(cmd -> path);
+            free(cmd);
+            return;
+        }
+    }
+}
+
+/* clearhash - Empty the command hash table */
+void clearhash(void) {
+    struct cmd_t *cmd, *next;
+    int i;
+
+    for (i = 0; i < CMDBUCKETS; i++) {
+        for (cmd = cmdtab[i]; cmd != NULL; cmd = next) {
+            next = cmd -> next;
+            free(cmd -> name);
+            free(cmd -> path);
+            free(cmd);
+        }
+        cmdtab[i] = NULL;
+    }
+}
+/****************************************
+ * end command hash table helper routines
+ ****************************************/
+
+
 /***********************
  * Other helper routines
  ***********************/
@@ -650,13 +1801,28 @@ void listjobs(struct job_t *jobs) {
  * usage - print a help message
  */
 void usage(void) {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpfes]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -f   launch jobs with fork and execve instead of posix_spawn\n");
+    printf("   -e   handle signals from a signalfd in an event loop\n");
+    printf("   -s   run a script: no prompt, input read in blocks, fewer flushes\n");
     exit(1);
 }
 
+/*
+ * printusage - Print the time from start to end and the CPU time and
+ *     peak memory in ru
+ */
+void printusage(const struct timespec *start, const struct timespec *end, const struct rusage *ru) {
+    printf("real %.3fs  user %.3fs  sys %.3fs  maxrss %ldK\n",
+           (end -> tv_sec - start -> tv_sec) + (end -> tv_nsec - start -> tv_nsec) / 1e9,
+           ru -> ru_utime.tv_sec + ru -> ru_utime.tv_usec / 1e6,
+           ru -> ru_stime.tv_sec + ru -> ru_stime.tv_usec / 1e6,
+           ru -> ru_maxrss);
+}
+
 /*
  * unix_error - unix-style error routine
  */
@@ -758,6 +1924,13 @@ pid_t Getpgrp(void) {
     return getpgrp();
 }
 
+/* Pipe - Close-on-exec pipe, with a PIPESIZE buffer if the kernel grants it */
+void Pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) < 0)
+	    unix_error("Pipe error");
+    (void)fcntl(fds[1], F_SETPIPE_SZ, PIPESIZE);   /* best effort */
+}
+
 /************************************
  * Wrappers for Unix signal functions 
  ***********************************/
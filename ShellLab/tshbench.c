@@ -0,0 +1,324 @@
+/*
+ * tshbench.c - A job control benchmark for your tiny shell
+ *
+ * usage: tshbench [-h] [-s <shell>] [-a <args>] [-r <rounds>] [-n <jobs>]
+ *
+ * Drives the shell through pipes, like sdriver.pl, and measures
+ *   exec:  latency from writing a command line to the job running,
+ *   reap:  latency from a foreground job exiting to the next prompt,
+ *   stop:  latency from ctrl-z to the shell reporting the job stopped,
+ *   bg/fg: latency from the bg/fg command to the job being continued,
+ * over <rounds> jobs each, and the launch throughput of <jobs>
+ * background jobs. The jobs are tshbench itself, run with -c, which
+ * stamp the time of what happens to them on the shell's output.
+ *
+ * The shell must print its prompt, since that is how tshbench knows
+ * it is ready, so -p and -s are left out of <args>.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAXARGS  32       /* max args for the shell */
+#define OUTBUF   (1<<16)  /* shell output not yet matched */
+#define TIMEOUT  10000    /* ms to wait for the shell to say something */
+
+char prompt[] = "tsh> ";
+char self[4096];          /* path of this program, to run as the jobs */
+pid_t shell;              /* the shell's pid */
+int to_shell, from_shell; /* its stdin and stdout */
+char out[OUTBUF];         /* its output, from the last match on */
+size_t outlen;
+
+/* now - CLOCK_MONOTONIC in nanoseconds, which all processes share */
+static long long now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* stamp - Write "@<tag> <time>\n" with one write, safe in a handler */
+static void stamp(const char *tag) {
+    char buf[64], digits[24];
+    long long t = now();
+    int n = 0, i = 0;
+
+    buf[n++] = '@';
+    while (*tag)
+        buf[n++] = *tag++;
+    buf[n++] = ' ';
+    do {
+        digits[i++] = '0' + t % 10;
+    } while ((t /= 10) > 0);
+    while (i > 0)
+        buf[n++] = digits[--i];
+    buf[n++] = '\n';
+    (void)write(1, buf, n);
+}
+
+static void cont_handler(int sig) {
+    stamp("cont");
+}
+
+/*
+ * child - Run as a job of the shell: "stamp" stamps its start and
+ *     exits, "exit" just exits, and "spin" waits for signals, stamping
+ *     each SIGCONT
+ */
+static void child(char *what) {
+    if (!strcmp(what, "stamp")) {
+        stamp("stamp");
+    } else if (!strcmp(what, "spin")) {
+        signal(SIGCONT, cont_handler);
+        stamp("spin");
+        while (1)
+            pause();
+    }
+    _exit(0);
+}
+
+/*
+ * expect - Wait for the shell to print pat, and if line is not NULL,
+ *     the rest of its line, which is copied there. Only what matched is
+ *     taken out of the output, unless skip is set, when everything
+ *     before it goes too. Returns the time the match was read.
+ */
+static long long expect(const char *pat, char *line, int skip) {
+    struct pollfd pfd = { from_shell, POLLIN, 0 };
+    long long when = now();
+    char *at, *end = NULL;
+    size_t from, to;
+    ssize_t n;
+
+    while ((at = memmem(out, outlen, pat, strlen(pat))) == NULL
+           || (line && (end = memchr(at, '\n', out + outlen - at)) == NULL)) {
+        if (outlen == OUTBUF) {
+            fprintf(stderr, "tshbench: shell output overflow waiting for \"%s\"\n", pat);
+            exit(1);
+        }
+        if (poll(&pfd, 1, TIMEOUT) == 0) {
+            fprintf(stderr, "tshbench: shell did not print \"%s\"\n", pat);
+            exit(1);
+        }
+        if ((n = read(from_shell, out + outlen, OUTBUF - outlen)) <= 0) {
+            fprintf(stderr, "tshbench: shell exited waiting for \"%s\"\n", pat);
+            exit(1);
+        }
+        outlen += n;
+        when = now();
+    }
+
+    from = skip ? 0 : at - out;
+    to = (at - out) + strlen(pat);
+    if (line) {
+        memcpy(line, at + strlen(pat), end - at - strlen(pat));
+        line[end - at - strlen(pat)] = '\0';
+        to = end - out + 1;
+    }
+    memmove(out + from, out + to, outlen - to);
+    outlen -= to - from;
+    return when;
+}
+
+/* send - Write a command line to the shell */
+static void send(const char *cmd) {
+    size_t len = strlen(cmd), done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        if ((n = write(to_shell, cmd + done, len - done)) < 0) {
+            perror("tshbench: write");
+            exit(1);
+        }
+        done += n;
+    }
+}
+
+/* start - Run the shell with its stdin and stdout on pipes to us */
+static void start(char *path, char **argv) {
+    int in[2], outp[2];
+
+    if (pipe(in) < 0 || pipe(outp) < 0) {
+        perror("tshbench: pipe");
+        exit(1);
+    }
+    if ((shell = fork()) == 0) {
+        dup2(in[0], 0);
+        dup2(outp[1], 1);
+        dup2(outp[1], 2);
+        close(in[0]); close(in[1]);
+        close(outp[0]); close(outp[1]);
+        execv(path, argv);
+        fprintf(stderr, "tshbench: cannot run %s\n", path);
+        _exit(1);
+    }
+    close(in[0]);
+    close(outp[1]);
+    to_shell = in[1];
+    from_shell = outp[0];
+    expect(prompt, NULL, 1);
+}
+
+static int cmp(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* report - Print a summary of n latencies in nanoseconds, in microseconds */
+static void report(const char *name, long long *lat, int n) {
+    double sum = 0;
+    int i;
+
+    qsort(lat, n, sizeof(long long), cmp);
+    for (i = 0; i < n; i++)
+        sum += lat[i];
+    printf("%-6s %6d   min %8.1f  med %8.1f  mean %8.1f  p99 %8.1f  max %8.1f us\n",
+           name, n, lat[0] / 1e3, lat[n / 2] / 1e3, sum / n / 1e3,
+           lat[n * 99 / 100] / 1e3, lat[n - 1] / 1e3);
+}
+
+static void usage(char *name) {
+    printf("Usage: %s [-h] [-s <shell>] [-a <args>] [-r <rounds>] [-n <jobs>]\n", name);
+    printf("   -h          print this message\n");
+    printf("   -s <shell>  shell to measure (default ./tsh)\n");
+    printf("   -a <args>   arguments for the shell, apart from -p and -s\n");
+    printf("   -r <rounds> jobs to time each latency over (default 200)\n");
+    printf("   -n <jobs>   background jobs to measure launch throughput with (default 2000)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    char *path = "./tsh", *args = "";
+    char *shell_argv[MAXARGS + 2], cmd[8192], line[256], *arg;
+    long long *exec_lat, *reap_lat, *stop_lat, *bg_lat, *fg_lat;
+    long long t0, t1, begin, end;
+    int rounds = 200, njobs = 2000, nargs = 0, i, c;
+    ssize_t n;
+
+    if (argc == 3 && !strcmp(argv[1], "-c"))
+        child(argv[2]);
+
+    while ((c = getopt(argc, argv, "hs:a:r:n:")) != EOF) {
+        switch (c) {
+            case 's':
+                path = optarg;
+                break;
+            case 'a':
+                args = optarg;
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            case 'n':
+                njobs = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (rounds < 1 || njobs < 1)
+        usage(argv[0]);
+
+    if ((n = readlink("/proc/self/exe", self, sizeof(self) - 1)) < 0) {
+        perror("tshbench: readlink");
+        exit(1);
+    }
+    self[n] = '\0';
+
+    shell_argv[nargs++] = path;
+    for (arg = strtok(strdup(args), " "); arg && nargs < MAXARGS; arg = strtok(NULL, " "))
+        if (strcmp(arg, "-p") && strcmp(arg, "-s"))
+            shell_argv[nargs++] = arg;
+    shell_argv[nargs] = NULL;
+
+    exec_lat = malloc(rounds * sizeof(long long));
+    reap_lat = malloc(rounds * sizeof(long long));
+    stop_lat = malloc(rounds * sizeof(long long));
+    bg_lat = malloc(rounds * sizeof(long long));
+    fg_lat = malloc(rounds * sizeof(long long));
+    if (!exec_lat || !reap_lat || !stop_lat || !bg_lat || !fg_lat) {
+        perror("tshbench: malloc");
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    start(path, shell_argv);
+
+    /* Foreground jobs: command line to exec, exit to prompt */
+    snprintf(cmd, sizeof(cmd), "%s -c stamp\n", self);
+    for (i = 0; i < rounds; i++) {
+        t0 = now();
+        send(cmd);
+        expect("@stamp ", line, 0);
+        t1 = atoll(line);
+        exec_lat[i] = t1 - t0;
+        reap_lat[i] = expect(prompt, NULL, 1) - t1;
+    }
+
+    /* Job control: ctrl-z, bg, fg, then ctrl-c */
+    snprintf(cmd, sizeof(cmd), "%s -c spin\n", self);
+    for (i = 0; i < rounds; i++) {
+        send(cmd);
+        expect("@spin ", line, 0);
+
+        t0 = now();
+        kill(shell, SIGTSTP);
+        stop_lat[i] = expect("stopped by signal", NULL, 0) - t0;
+        expect(prompt, NULL, 0);
+
+        t0 = now();
+        send("bg %1\n");
+        expect("@cont ", line, 0);
+        bg_lat[i] = atoll(line) - t0;
+        expect(prompt, NULL, 0);
+
+        t0 = now();
+        send("fg %1\n");
+        expect("@cont ", line, 0);
+        fg_lat[i] = atoll(line) - t0;
+
+        kill(shell, SIGINT);
+        expect("terminated by signal", NULL, 0);
+        expect(prompt, NULL, 1);
+    }
+
+    /* Launch throughput: njobs background jobs, then wait for them all */
+    snprintf(cmd, sizeof(cmd), "%s -c exit &\n", self);
+    begin = now();
+    if (fork() == 0) {      /* writes while we read, so neither pipe fills */
+        for (i = 0; i < njobs; i++)
+            send(cmd);
+        send("wait\n");
+        _exit(0);
+    }
+    for (i = 0; i <= njobs; i++)
+        expect(prompt, NULL, 1);
+    end = now();
+    wait(NULL);
+
+    send("quit\n");
+    close(to_shell);
+    waitpid(shell, NULL, 0);
+
+    for (i = 0; i < nargs; i++)
+        printf("%s ", shell_argv[i]);
+    printf(": %d rounds\n", rounds);
+    report("exec", exec_lat, rounds);
+    report("reap", reap_lat, rounds);
+    report("stop", stop_lat, rounds);
+    report("bg", bg_lat, rounds);
+    report("fg", fg_lat, rounds);
+    printf("launch %6d jobs in %.3fs: %.0f jobs/s\n", njobs,
+           (end - begin) / 1e9, njobs / ((end - begin) / 1e9));
+    exit(0);
+}